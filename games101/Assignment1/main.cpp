@@ -134,13 +134,17 @@ int main(int argc, const char **argv)
     {
         command_line = true;
         angle = std::stof(argv[2]); // -r by default
-        if (argc == 4)
+        if (argc >= 4)
         {
             filename = std::string(argv[3]);
         }
     }
 
     rst::rasterizer r(700, 700);
+    if (argc >= 5 && std::string(argv[4]) == "aa")
+    {
+        r.set_line_mode(rst::LineMode::Antialiased);
+    }
 
     Eigen::Vector3f eye_pos = {0, 0, 5};
 
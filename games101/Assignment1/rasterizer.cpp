@@ -22,108 +22,146 @@ rst::ind_buf_id rst::rasterizer::load_indices(const std::vector<Eigen::Vector3i>
     auto id = get_next_id();
     ind_buf.emplace(id, indices);
 
+    // Each edge shared by two triangles is only drawn once.
+    std::vector<Eigen::Vector2i> edges;
+    edges.reserve(indices.size() * 3);
+    for (auto& i : indices)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            int a = i[k], b = i[(k + 1) % 3];
+            edges.emplace_back(std::min(a, b), std::max(a, b));
+        }
+    }
+    auto by_index = [](const Eigen::Vector2i& a, const Eigen::Vector2i& b) {
+        return a.x() != b.x() ? a.x() < b.x() : a.y() < b.y();
+    };
+    std::sort(edges.begin(), edges.end(), by_index);
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    edge_buf.emplace(id, std::move(edges));
+
     return {id};
 }
 
-// Bresenham's line drawing algorithm
-// Code taken from a stack overflow answer: https://stackoverflow.com/a/16405254
-void rst::rasterizer::draw_line(Eigen::Vector3f begin, Eigen::Vector3f end)
+// Outside codes of a point against [0, width - 1] x [0, height - 1]
+static int outcode(const Eigen::Vector2f& p, int width, int height)
 {
-    auto x1 = begin.x();
-    auto y1 = begin.y();
-    auto x2 = end.x();
-    auto y2 = end.y();
-
-    Eigen::Vector3f line_color = {255, 255, 255};
-
-    int x,y,dx,dy,dx1,dy1,px,py,xe,ye,i;
+    return (p.x() < 0) | (p.x() > width - 1) << 1 | (p.y() < 0) << 2 | (p.y() > height - 1) << 3;
+}
 
-    dx=x2-x1;
-    dy=y2-y1;
-    dx1=fabs(dx);
-    dy1=fabs(dy);
-    px=2*dy1-dx1;
-    py=2*dx1-dy1;
+void rst::rasterizer::draw_line(Eigen::Vector2f begin, Eigen::Vector2f end, const Eigen::Vector3f& color)
+{
+    // vertices on the eye plane divide to infinity
+    if (!begin.allFinite() || !end.allFinite())
+        return;
+
+    // Cohen-Sutherland trivially accepts and rejects, Liang-Barsky cuts the rest
+    int begin_code = outcode(begin, width, height), end_code = outcode(end, width, height);
+    if (begin_code & end_code)
+        return;
+    if ((begin_code | end_code) && !clip_line(begin, end))
+        return;
+
+    if (line_mode == LineMode::Antialiased)
+        draw_line_antialiased(begin, end, color);
+    else
+        // truncated like the float Bresenham this replaced
+        draw_line_aliased(int(begin.x()), int(begin.y()), int(end.x()), int(end.y()), color);
+}
 
-    if(dy1<=dx1)
+// Liang-Barsky: keeps the part of begin-end inside [0, width - 1] x [0, height - 1].
+// Returns false when nothing is left.
+bool rst::rasterizer::clip_line(Eigen::Vector2f& begin, Eigen::Vector2f& end) const
+{
+    Eigen::Vector2f d = end - begin;
+    const float p[] = {-d.x(), d.x(), -d.y(), d.y()};
+    const float q[] = {begin.x(), width - 1 - begin.x(), begin.y(), height - 1 - begin.y()};
+    float t0 = 0, t1 = 1;
+    for (int i = 0; i < 4; ++i)
     {
-        if(dx>=0)
+        if (p[i] == 0)
         {
-            x=x1;
-            y=y1;
-            xe=x2;
+            // parallel to this side
+            if (q[i] < 0)
+                return false;
+            continue;
         }
+        float t = q[i] / p[i];
+        if (p[i] < 0)
+            t0 = std::max(t0, t);
         else
-        {
-            x=x2;
-            y=y2;
-            xe=x1;
-        }
-        Eigen::Vector3f point = Eigen::Vector3f(x, y, 1.0f);
-        set_pixel(point,line_color);
-        for(i=0;x<xe;i++)
-        {
-            x=x+1;
-            if(px<0)
-            {
-                px=px+2*dy1;
-            }
-            else
-            {
-                if((dx<0 && dy<0) || (dx>0 && dy>0))
-                {
-                    y=y+1;
-                }
-                else
-                {
-                    y=y-1;
-                }
-                px=px+2*(dy1-dx1);
-            }
-//            delay(0);
-            Eigen::Vector3f point = Eigen::Vector3f(x, y, 1.0f);
-            set_pixel(point,line_color);
-        }
+            t1 = std::min(t1, t);
+        if (t0 > t1)
+            return false;
     }
-    else
+    end = begin + t1 * d;
+    begin = begin + t0 * d;
+    return true;
+}
+
+// Integer Bresenham over frame_buf indices; both ends must be on screen.
+void rst::rasterizer::draw_line_aliased(int x0, int y0, int x1, int y1, const Eigen::Vector3f& color)
+{
+    int dx = std::abs(x1 - x0), dy = std::abs(y1 - y0);
+    // rows are stored top down, so going up a pixel goes back a row
+    int step_x = x1 >= x0 ? 1 : -1;
+    int step_y = y1 >= y0 ? -width : width;
+    int major = std::max(dx, dy), minor = std::min(dx, dy);
+    int major_step = dx >= dy ? step_x : step_y, minor_step = dx >= dy ? step_y : step_x;
+
+    Eigen::Vector3f* pixels = frame_buf.data();
+    int index = get_index(x0, y0);
+    int error = 2 * minor - major;
+    for (int i = 0; i <= major; ++i)
     {
-        if(dy>=0)
-        {
-            x=x1;
-            y=y1;
-            ye=y2;
-        }
-        else
-        {
-            x=x2;
-            y=y2;
-            ye=y1;
-        }
-        Eigen::Vector3f point = Eigen::Vector3f(x, y, 1.0f);
-        set_pixel(point,line_color);
-        for(i=0;y<ye;i++)
+        pixels[index] = color;
+        if (i == major)
+            break;
+        if (error > 0)
         {
-            y=y+1;
-            if(py<=0)
-            {
-                py=py+2*dx1;
-            }
-            else
-            {
-                if((dx<0 && dy<0) || (dx>0 && dy>0))
-                {
-                    x=x+1;
-                }
-                else
-                {
-                    x=x-1;
-                }
-                py=py+2*(dx1-dy1);
-            }
-//            delay(0);
-            Eigen::Vector3f point = Eigen::Vector3f(x, y, 1.0f);
-            set_pixel(point,line_color);
+            index += minor_step;
+            error -= 2 * major;
         }
+        error += 2 * minor;
+        index += major_step;
+    }
+}
+
+// Xiaolin Wu's line: every step along the major axis blends color into the two
+// pixels straddling the line, weighted by how close their centres are to it.
+void rst::rasterizer::draw_line_antialiased(Eigen::Vector2f begin, Eigen::Vector2f end, const Eigen::Vector3f& color)
+{
+    // pixel x covers [x, x + 1), so its centre is at x + 0.5
+    begin -= Eigen::Vector2f(0.5f, 0.5f);
+    end -= Eigen::Vector2f(0.5f, 0.5f);
+
+    bool steep = std::abs(end.y() - begin.y()) > std::abs(end.x() - begin.x());
+    if (steep)
+    {
+        std::swap(begin.x(), begin.y());
+        std::swap(end.x(), end.y());
+    }
+    if (begin.x() > end.x())
+        std::swap(begin, end);
+    float gradient = end.x() > begin.x() ? (end.y() - begin.y()) / (end.x() - begin.x()) : 0.0f;
+
+    Eigen::Vector3f* pixels = frame_buf.data();
+    auto blend = [&](int major, int minor, float coverage) {
+        int x = steep ? minor : major, y = steep ? major : minor;
+        if (x < 0 || x >= width || y < 0 || y >= height)
+            return;
+        Eigen::Vector3f& pixel = pixels[get_index(x, y)];
+        pixel += (color - pixel) * coverage;
+    };
+
+    int last = int(std::lround(end.x()));
+    for (int major = int(std::lround(begin.x())); major <= last; ++major)
+    {
+        float minor = begin.y() + gradient * (major - begin.x());
+        int below = int(std::floor(minor));
+        float coverage = minor - below;
+        blend(major, below, 1 - coverage);
+        blend(major, below + 1, coverage);
     }
 }
 
@@ -139,53 +177,24 @@ void rst::rasterizer::draw(rst::pos_buf_id pos_buffer, rst::ind_buf_id ind_buffe
         throw std::runtime_error("Drawing primitives other than triangle is not implemented yet!");
     }
     auto& buf = pos_buf[pos_buffer.pos_id];
-    auto& ind = ind_buf[ind_buffer.ind_id];
-
-    float f1 = (100 - 0.1) / 2.0;
-    float f2 = (100 + 0.1) / 2.0;
+    auto& edges = edge_buf[ind_buffer.ind_id];
 
     Eigen::Matrix4f mvp = projection * view * model;
-    for (auto& i : ind)
+    // Every vertex is transformed once, however many edges share it.
+    screen_buf.resize(buf.size());
+    for (size_t i = 0; i < buf.size(); ++i)
     {
-        Triangle t;
-
-        Eigen::Vector4f v[] = {
-                mvp * to_vec4(buf[i[0]], 1.0f),
-                mvp * to_vec4(buf[i[1]], 1.0f),
-                mvp * to_vec4(buf[i[2]], 1.0f)
-        };
-
-        for (auto& vec : v) {
-            vec /= vec.w();
-        }
-
-        for (auto & vert : v)
-        {
-            vert.x() = 0.5*width*(vert.x()+1.0);
-            vert.y() = 0.5*height*(vert.y()+1.0);
-            vert.z() = vert.z() * f1 + f2;
-        }
-
-        for (int i = 0; i < 3; ++i)
-        {
-            t.setVertex(i, v[i].head<3>());
-            t.setVertex(i, v[i].head<3>());
-            t.setVertex(i, v[i].head<3>());
-        }
-
-        t.setColor(0, 255.0,  0.0,  0.0);
-        t.setColor(1, 0.0  ,255.0,  0.0);
-        t.setColor(2, 0.0  ,  0.0,255.0);
-
-        rasterize_wireframe(t);
+        Eigen::Vector4f v = mvp * to_vec4(buf[i], 1.0f);
+        v /= v.w();
+        screen_buf[i].x() = 0.5*width*(v.x()+1.0);
+        screen_buf[i].y() = 0.5*height*(v.y()+1.0);
     }
-}
 
-void rst::rasterizer::rasterize_wireframe(const Triangle& t)
-{
-    draw_line(t.c(), t.a());
-    draw_line(t.c(), t.b());
-    draw_line(t.b(), t.a());
+    Eigen::Vector3f line_color = {255, 255, 255};
+    for (auto& e : edges)
+    {
+        draw_line(screen_buf[e[0]], screen_buf[e[1]], line_color);
+    }
 }
 
 void rst::rasterizer::set_model(const Eigen::Matrix4f& m)
@@ -223,7 +232,7 @@ rst::rasterizer::rasterizer(int w, int h) : width(w), height(h)
 
 int rst::rasterizer::get_index(int x, int y)
 {
-    return (height-y)*width + x;
+    return (height-1-y)*width + x;
 }
 
 void rst::rasterizer::set_pixel(const Eigen::Vector3f& point, const Eigen::Vector3f& color)
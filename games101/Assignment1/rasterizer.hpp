@@ -6,6 +6,8 @@
 
 #include "Triangle.hpp"
 #include <algorithm>
+#include <map>
+#include <vector>
 #include <eigen3/Eigen/Eigen>
 using namespace Eigen;
 
@@ -32,6 +34,14 @@ enum class Primitive
     Triangle
 };
 
+// How wireframe edges are drawn: one pixel per step with an integer Bresenham
+// walk, or Xiaolin Wu's two pixels per step weighted by coverage.
+enum class LineMode
+{
+    Aliased,
+    Antialiased
+};
+
 /*
  * For the curious : The draw function takes two buffer id's as its arguments.
  * These two structs make sure that if you mix up with their orders, the
@@ -57,6 +67,7 @@ class rasterizer
     void set_model(const Eigen::Matrix4f& m);
     void set_view(const Eigen::Matrix4f& v);
     void set_projection(const Eigen::Matrix4f& p);
+    void set_line_mode(LineMode mode) { line_mode = mode; }
 
     void set_pixel(const Eigen::Vector3f& point, const Eigen::Vector3f& color);
 
@@ -67,8 +78,11 @@ class rasterizer
     std::vector<Eigen::Vector3f>& frame_buffer() { return frame_buf; }
 
   private:
-    void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
-    void rasterize_wireframe(const Triangle& t);
+    // Clips begin-end to the screen and draws what is left in line_mode.
+    void draw_line(Eigen::Vector2f begin, Eigen::Vector2f end, const Eigen::Vector3f& color);
+    bool clip_line(Eigen::Vector2f& begin, Eigen::Vector2f& end) const;
+    void draw_line_aliased(int x0, int y0, int x1, int y1, const Eigen::Vector3f& color);
+    void draw_line_antialiased(Eigen::Vector2f begin, Eigen::Vector2f end, const Eigen::Vector3f& color);
 
   private:
     Eigen::Matrix4f model;
@@ -77,6 +91,11 @@ class rasterizer
 
     std::map<int, std::vector<Eigen::Vector3f>> pos_buf;
     std::map<int, std::vector<Eigen::Vector3i>> ind_buf;
+    // Unique edges of each index buffer as sorted vertex index pairs, built by load_indices
+    std::map<int, std::vector<Eigen::Vector2i>> edge_buf;
+
+    std::vector<Eigen::Vector2f> screen_buf; // per vertex screen position of the current draw
+    LineMode line_mode = LineMode::Aliased;
 
     std::vector<Eigen::Vector3f> frame_buf;
     std::vector<float> depth_buf;
@@ -0,0 +1,113 @@
+//
+// Small persistent worker pool used by the rasterizer to run data parallel loops.
+//
+
+#ifndef RASTERIZER_THREADPOOL_H
+#define RASTERIZER_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // threads counts the calling thread as well, so ThreadPool(1) runs everything inline.
+    explicit ThreadPool(int threads)
+    {
+        for (int i = 1; i < threads; ++i)
+            workers.emplace_back([this] { worker_loop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (auto& w : workers)
+            w.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return int(workers.size()) + 1; }
+
+    // Calls job(i) for every i in [0, count). Items are handed out dynamically, the
+    // caller takes part in the work and the call returns once every item is done.
+    void parallel_for(int count, const std::function<void(int)>& job)
+    {
+        if (count <= 0)
+            return;
+        if (workers.empty())
+        {
+            for (int i = 0; i < count; ++i)
+                job(i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = &job;
+            total = count;
+            next = 0;
+            pending = int(workers.size());
+            ++generation;
+        }
+        wake.notify_all();
+
+        run_items();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+        current = nullptr;
+    }
+
+private:
+    void run_items()
+    {
+        for (int i = next.fetch_add(1); i < total; i = next.fetch_add(1))
+            (*current)(i);
+    }
+
+    void worker_loop()
+    {
+        unsigned long seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stop || generation != seen; });
+                if (stop)
+                    return;
+                seen = generation;
+            }
+
+            run_items();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0)
+                done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const std::function<void(int)>* current = nullptr;
+    int total = 0;
+    std::atomic<int> next{0};
+    int pending = 0;
+    unsigned long generation = 0;
+    bool stop = false;
+};
+
+#endif //RASTERIZER_THREADPOOL_H
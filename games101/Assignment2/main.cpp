@@ -1,5 +1,8 @@
 // clang-format off
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <thread>
 #include <opencv2/opencv.hpp>
 #include "rasterizer.hpp"
 #include "global.hpp"
@@ -75,19 +78,55 @@ Eigen::Matrix4f get_projection_matrix(float eye_fov, float aspect_ratio, float z
     return projection;
 }
 
+// Renders frames frames at every sample count and prints the time per frame, split
+// into clear and draw and resolve, and the memory the sample buffers take.
+static void msaa_report(rst::rasterizer& r, rst::pos_buf_id pos_id, rst::ind_buf_id ind_id, rst::col_buf_id col_id,
+                        int frames)
+{
+    using clock = std::chrono::steady_clock;
+    for (int samples : {1, 2, 4, 8})
+    {
+        r.set_msaa(samples);
+        double draw_ms = 0, resolve_ms = 0;
+        for (int frame = -1; frame < frames; ++frame) // one warm up frame
+        {
+            auto start = clock::now();
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+            r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
+            auto drawn = clock::now();
+            r.resolve();
+            auto resolved = clock::now();
+            if (frame < 0)
+                continue;
+            draw_ms += std::chrono::duration<double, std::milli>(drawn - start).count();
+            resolve_ms += std::chrono::duration<double, std::milli>(resolved - drawn).count();
+        }
+        std::cout << "msaa " << samples << "x: " << (draw_ms + resolve_ms) / frames << " ms/frame (clear and draw "
+                  << draw_ms / frames << ", resolve " << resolve_ms / frames << "), sample buffers "
+                  << r.sample_memory() / (1024.0 * 1024.0) << " MiB\n";
+    }
+}
+
 int main(int argc, const char** argv)
 {
     float angle = 0;
     bool command_line = false;
     std::string filename = "output.png";
+    int msaa = 4;
 
-    if (argc == 2)
+    // Rasterizer [output.png [samples]] | Rasterizer --msaa-report [frames]
+    bool report = argc >= 2 && std::string(argv[1]) == "--msaa-report";
+    if (argc >= 2 && !report)
     {
         command_line = true;
         filename = std::string(argv[1]);
+        if (argc >= 3)
+            msaa = std::atoi(argv[2]);
     }
 
     rst::rasterizer r(700, 700);
+    r.set_msaa(msaa);
+    r.set_resolve_threads(int(std::thread::hardware_concurrency()));
 
     Eigen::Vector3f eye_pos = {0,0,5};
 
@@ -125,6 +164,15 @@ int main(int argc, const char** argv)
     int key = 0;
     int frame_count = 0;
 
+    if (report)
+    {
+        r.set_model(get_model_matrix(angle));
+        r.set_view(get_view_matrix(eye_pos));
+        r.set_projection(get_projection_matrix(45, 1, 0.1, 50));
+        msaa_report(r, pos_id, ind_id, col_id, argc >= 3 ? std::max(1, std::atoi(argv[2])) : 100);
+        return 0;
+    }
+
     if (command_line)
     {
         r.clear(rst::Buffers::Color | rst::Buffers::Depth);
@@ -134,6 +182,7 @@ int main(int argc, const char** argv)
         r.set_projection(get_projection_matrix(45, 1, 0.1, 50));
 
         r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
+        r.resolve();
         cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
         image.convertTo(image, CV_8UC3, 1.0f);
         cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
@@ -152,6 +201,7 @@ int main(int argc, const char** argv)
         r.set_projection(get_projection_matrix(45, 1, 0.1, 50));
 
         r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
+        r.resolve();
 
         cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
         image.convertTo(image, CV_8UC3, 1.0f);
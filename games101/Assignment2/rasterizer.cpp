@@ -4,6 +4,7 @@
 //
 
 #include <algorithm>
+#include <cstdint>
 #include <vector>
 #include "rasterizer.hpp"
 #include <opencv2/opencv.hpp>
@@ -40,25 +41,154 @@ auto to_vec4(const Eigen::Vector3f& v3, float w = 1.0f)
 }
 
 
-static bool insideTriangle(int x, int y, const Vector3f* _v)
-{   
-    // TODO : Implement this function to check if the point (x, y) is inside the triangle represented by _v[0], _v[1], _v[2]
-    float c1 = (x*(_v[1].y() - _v[2].y()) + (_v[2].x() - _v[1].x())*y + _v[1].x()*_v[2].y() - _v[2].x()*_v[1].y()) / (_v[0].x()*(_v[1].y() - _v[2].y()) + (_v[2].x() - _v[1].x())*_v[0].y() + _v[1].x()*_v[2].y() - _v[2].x()*_v[1].y());
-    float c2 = (x*(_v[2].y() - _v[0].y()) + (_v[0].x() - _v[2].x())*y + _v[2].x()*_v[0].y() - _v[0].x()*_v[2].y()) / (_v[1].x()*(_v[2].y() - _v[0].y()) + (_v[0].x() - _v[2].x())*_v[1].y() + _v[2].x()*_v[0].y() - _v[0].x()*_v[2].y());
-    float c3 = (x*(_v[0].y() - _v[1].y()) + (_v[1].x() - _v[0].x())*y + _v[0].x()*_v[1].y() - _v[1].x()*_v[0].y()) / (_v[2].x()*(_v[0].y() - _v[1].y()) + (_v[1].x() - _v[0].x())*_v[2].y() + _v[0].x()*_v[1].y() - _v[1].x()*_v[0].y());
+// Vertices are snapped to a 1/16 pixel grid so the edge functions below are exact
+// integers that can be stepped by addition without drift.
+constexpr int SUBPIXEL_BITS = 4;
+constexpr int64_t SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+constexpr int64_t SUBPIXEL_HALF = SUBPIXEL_ONE / 2;
+// Offset of the 2x2 coverage samples from the pixel centre (a quarter pixel).
+constexpr int64_t SAMPLE_OFFSET = SUBPIXEL_ONE / 4;
+// Largest screen coordinate we accept before snapping.
+constexpr float MAX_SCREEN_COORD = float(1 << 20);
+
+// MSAA sample positions relative to the pixel centre, in subpixel units: the standard
+// D3D patterns, which all lie on the 1/16 pixel grid.
+constexpr int MAX_MSAA_SAMPLES = 8;
+constexpr int MSAA_2X[2][2] = {{4, 4}, {-4, -4}};
+constexpr int MSAA_4X[4][2] = {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}};
+constexpr int MSAA_8X[8][2] = {{1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}};
+
+static const int (*msaa_pattern(int samples))[2]
+{
+    return samples == 8 ? MSAA_8X : samples == 4 ? MSAA_4X : MSAA_2X;
+}
+
+struct edge_setup
+{
+    int64_t step_x[3];  // E_i(x + 1, y) - E_i(x, y)
+    int64_t step_y[3];  // E_i(x, y + 1) - E_i(x, y)
+    int64_t origin[3];  // E_i at the centre of pixel (x0, y0)
+    int64_t bias[3];    // 0 for edges owned by this triangle (top-left rule), 1 otherwise
+    int64_t sample[rst::PIXEL_SAMPLES][3]; // E_i(sample j) - E_i(pixel centre)
+    float inv_area;     // 1 / sum of the edge functions, turns E_i into barycentrics
+    int x0, y0, x1, y1; // pixels that may have a covered sample, clipped to the screen
+};
+
+// reach: how far, in subpixel units, samples lie from the pixel centre in x and y.
+static bool setup_edges(const Triangle& t, int width, int height, int64_t reach, edge_setup& e)
+{
+    int64_t x[3], y[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        float fx = t.v[i].x(), fy = t.v[i].y();
+        if (!(std::abs(fx) < MAX_SCREEN_COORD && std::abs(fy) < MAX_SCREEN_COORD))
+            return false;
+        x[i] = std::llround(fx * SUBPIXEL_ONE);
+        y[i] = std::llround(fy * SUBPIXEL_ONE);
+    }
 
-    if (c1 < 1 && c1 > 0 && c2 < 1 && c2>0 && c3 < 1 && c3 > 0) 
-        return true;
-    else 
+    // pixel p has samples in [p * ONE + HALF - reach, p * ONE + HALF + reach]
+    auto first = [reach](int64_t lo) { return int((lo - SUBPIXEL_HALF - reach + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS); };
+    auto last = [reach](int64_t hi) { return int((hi - SUBPIXEL_HALF + reach) >> SUBPIXEL_BITS); };
+    e.x0 = std::max(first(std::min({x[0], x[1], x[2]})), 0);
+    e.y0 = std::max(first(std::min({y[0], y[1], y[2]})), 0);
+    e.x1 = std::min(last(std::max({x[0], x[1], x[2]})) + 1, width);
+    e.y1 = std::min(last(std::max({y[0], y[1], y[2]})) + 1, height);
+    if (e.x0 >= e.x1 || e.y0 >= e.y1)
         return false;
+
+    // Edge i is opposite vertex i, so E_i / area is that vertex's barycentric weight.
+    int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0)
+        return false;
+    // Accept both windings: flip the edges of clockwise triangles so the inside is positive.
+    int64_t sign = area > 0 ? 1 : -1;
+
+    const int64_t offsets[rst::PIXEL_SAMPLES][2] = {
+        {-SAMPLE_OFFSET, -SAMPLE_OFFSET}, {-SAMPLE_OFFSET, SAMPLE_OFFSET},
+        {SAMPLE_OFFSET, -SAMPLE_OFFSET}, {SAMPLE_OFFSET, SAMPLE_OFFSET}
+    };
+
+    int64_t px = e.x0 * SUBPIXEL_ONE + SUBPIXEL_HALF;
+    int64_t py = e.y0 * SUBPIXEL_ONE + SUBPIXEL_HALF;
+    for (int i = 0; i < 3; ++i)
+    {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        // E(p) = a * p.x + b * p.y + c for the directed edge v_j -> v_k
+        int64_t a = sign * (y[j] - y[k]);
+        int64_t b = sign * (x[k] - x[j]);
+        e.step_x[i] = a * SUBPIXEL_ONE;
+        e.step_y[i] = b * SUBPIXEL_ONE;
+        e.origin[i] = a * (px - x[j]) + b * (py - y[j]);
+        for (int s = 0; s < rst::PIXEL_SAMPLES; ++s)
+            e.sample[s][i] = a * offsets[s][0] + b * offsets[s][1];
+        // Top-left rule: a sample exactly on an edge is covered only for left edges
+        // (a > 0) and top edges (a == 0, b < 0), so shared edges are never counted twice.
+        bool owned = a > 0 || (a == 0 && b < 0);
+        e.bias[i] = owned ? 0 : 1;
+    }
+    e.inv_area = 1.0f / float(area * sign);
+    return true;
+}
+
+// True when every edge value the span kernels compute over the pixel rect, at the
+// centres moved by each of the count sample offsets, fits in int32. The edge
+// functions are linear, so the corners are enough.
+static bool fits_int32(const edge_setup& e, const int64_t (*offsets)[3], int count)
+{
+    int64_t dx = e.x1 - 1 - e.x0;
+    int64_t dy = e.y1 - 1 - e.y0;
+    for (int i = 0; i < 3; ++i)
+    {
+        int64_t corners[] = {
+            e.origin[i],
+            e.origin[i] + dx * e.step_x[i],
+            e.origin[i] + dy * e.step_y[i],
+            e.origin[i] + dx * e.step_x[i] + dy * e.step_y[i]
+        };
+        for (int64_t c : corners)
+            for (int s = 0; s < count; ++s)
+                if (c + offsets[s][i] < INT32_MIN || c + offsets[s][i] > INT32_MAX)
+                    return false;
+        if (e.step_x[i] < INT32_MIN || e.step_x[i] > INT32_MAX)
+            return false;
+    }
+    return true;
 }
 
-static std::tuple<float, float, float> computeBarycentric2D(float x, float y, const Vector3f* v)
+// Number of the count samples at w + offsets[s] that are inside the triangle.
+static int covered_samples(const edge_setup& e, const int64_t (*offsets)[3], int count, const int64_t (&w)[3])
 {
-    float c1 = (x*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*y + v[1].x()*v[2].y() - v[2].x()*v[1].y()) / (v[0].x()*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*v[0].y() + v[1].x()*v[2].y() - v[2].x()*v[1].y());
-    float c2 = (x*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*y + v[2].x()*v[0].y() - v[0].x()*v[2].y()) / (v[1].x()*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*v[1].y() + v[2].x()*v[0].y() - v[0].x()*v[2].y());
-    float c3 = (x*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*y + v[0].x()*v[1].y() - v[1].x()*v[0].y()) / (v[2].x()*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*v[2].y() + v[0].x()*v[1].y() - v[1].x()*v[0].y());
-    return {c1,c2,c3};
+    int covered = 0;
+    for (int s = 0; s < count; ++s)
+        covered += w[0] + offsets[s][0] >= e.bias[0] && w[1] + offsets[s][1] >= e.bias[1] &&
+                   w[2] + offsets[s][2] >= e.bias[2];
+    return covered;
+}
+
+// Span test for triangles too large for the 32-bit kernels; same depth expression.
+// A pixel is covered when any of the count samples at offsets from w is.
+static uint64_t raster_span_wide(const edge_setup& e, const int64_t (*offsets)[3], int count, const rst::span_setup& s,
+                                 const int64_t (&w)[3], int n, float* depth)
+{
+    uint64_t result = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        int64_t p[3] = {w[0] + i * e.step_x[0], w[1] + i * e.step_x[1], w[2] + i * e.step_x[2]};
+        if (covered_samples(e, offsets, count, p))
+        {
+            float alpha = float(p[0]) * s.inv_area;
+            float beta = float(p[1]) * s.inv_area;
+            float gamma = float(p[2]) * s.inv_area;
+            float z = alpha * s.z[0] + beta * s.z[1] + gamma * s.z[2];
+            if (z < depth[i])
+            {
+                depth[i] = z;
+                result |= uint64_t(1) << i;
+            }
+        }
+    }
+    return result;
 }
 
 void rst::rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type)
@@ -112,65 +242,188 @@ void rst::rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf
 
 //Screen space rasterization
 void rst::rasterizer::rasterize_triangle(const Triangle& t) {
-    auto v = t.toVector4();
-    
-    // TODO : Find out the bounding box of current triangle.
-    // iterate through the pixel and find if the current pixel is inside the triangle
-
-    // If so, use the following code to get the interpolated z value.
-    //auto[alpha, beta, gamma] = computeBarycentric2D(x, y, t.v);
-    //float w_reciprocal = 1.0/(alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
-    //float z_interpolated = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
-    //z_interpolated *= w_reciprocal;
-
-    // TODO : set the current pixel (use the set_pixel function) to the color of the triangle (use getColor function) if it should be painted.
-
-    int min_x = INT_MAX;
-    int max_x = INT_MIN;
-    int min_y = INT_MAX;
-    int max_y = INT_MIN;
-
-    for(auto point: v) { // bouding box
-        if (point[0] < min_x) min_x = point[0];
-        if (point[0] > max_x) max_x = point[0];
-        if (point[1] < min_y) min_y = point[1];
-        if (point[1] > max_y) max_y = point[1];
+    // Edge functions are set up once and stepped across the bounding box. A pixel is
+    // drawn when one of its 2x2 samples is covered and the depth at its centre passes;
+    // its color is scaled by the fraction of covered samples.
+    if (msaa_samples > 1)
+        return rasterize_triangle_msaa(t);
+
+    edge_setup e;
+    if (!setup_edges(t, width, height, SAMPLE_OFFSET, e))
+        return;
+
+    span_setup s;
+    s.inv_area = e.inv_area;
+    for (int i = 0; i < 3; ++i)
+    {
+        s.z[i] = t.v[i].z();
+        s.step_x[i] = int32_t(e.step_x[i]);
+        s.bias[i] = int32_t(e.bias[i]);
+        for (int j = 0; j < PIXEL_SAMPLES; ++j)
+            s.sample[j][i] = int32_t(e.sample[j][i]);
+    }
+    // Small triangles go through the 32-bit span kernels, the rest through the int64 one.
+    span_kernel kernel = fits_int32(e, e.sample, PIXEL_SAMPLES) ? span_fn : nullptr;
+
+    int64_t row[3] = {e.origin[0], e.origin[1], e.origin[2]};
+    for(int y = e.y0; y < e.y1; y++){
+        for(int x0 = e.x0; x0 < e.x1; x0 += SPAN_PIXELS){
+            int n = std::min(SPAN_PIXELS, e.x1 - x0);
+            int64_t w[3];
+            for (int i = 0; i < 3; ++i)
+                w[i] = row[i] + (x0 - e.x0) * e.step_x[i];
+
+            float* depth = &depth_buf[get_index(x0, y)];
+            uint64_t mask;
+            if (kernel) {
+                int32_t w32[3] = {int32_t(w[0]), int32_t(w[1]), int32_t(w[2])};
+                mask = kernel(s, w32, n, depth);
+            } else {
+                mask = raster_span_wide(e, e.sample, PIXEL_SAMPLES, s, w, n, depth);
+            }
+
+            while (mask) {
+                int i = __builtin_ctzll(mask);
+                mask &= mask - 1;
+
+                int64_t p[3] = {w[0] + i * e.step_x[0], w[1] + i * e.step_x[1], w[2] + i * e.step_x[2]};
+                float fineness = covered_samples(e, e.sample, PIXEL_SAMPLES, p) / float(PIXEL_SAMPLES);
+                Eigen::Vector3f point = {(float)(x0 + i), (float)y, depth[i]};
+                set_pixel(point, fineness * t.getColor());
+            }
+        }
+        for (int i = 0; i < 3; ++i)
+            row[i] += e.step_y[i];
     }
+}
+
+static uint32_t pack_color(const Eigen::Vector3f& color)
+{
+    uint32_t c = 0;
+    for (int i = 0; i < 3; ++i)
+        c |= uint32_t(std::lround(std::clamp(color[i], 0.0f, 255.0f))) << (8 * i);
+    return c;
+}
+
+// One pass of the span kernels per sample: moving the edge values to the sample turns
+// the kernels' centre test and centre depth into that sample's, so every sample plane
+// gets its own coverage and depth test.
+void rst::rasterizer::rasterize_triangle_msaa(const Triangle& t) {
+    edge_setup e;
+    if (!setup_edges(t, width, height, SUBPIXEL_HALF, e))
+        return;
+
+    // Only the centre of each kernel "pixel" is tested: all PIXEL_SAMPLES offsets are 0.
+    span_setup s = {};
+    s.inv_area = e.inv_area;
+    for (int i = 0; i < 3; ++i)
+    {
+        s.z[i] = t.v[i].z();
+        s.step_x[i] = int32_t(e.step_x[i]);
+        s.bias[i] = int32_t(e.bias[i]);
+    }
+
+    const int (*pattern)[2] = msaa_pattern(msaa_samples);
+    int64_t offset[MAX_MSAA_SAMPLES][3];
+    for (int j = 0; j < msaa_samples; ++j)
+        for (int i = 0; i < 3; ++i)
+            offset[j][i] = e.step_x[i] / SUBPIXEL_ONE * pattern[j][0] + e.step_y[i] / SUBPIXEL_ONE * pattern[j][1];
+    span_kernel kernel = fits_int32(e, offset, msaa_samples) ? span_fn : nullptr;
+    // w already sits on the sample, so the int64 fallback tests it with no further offset
+    const int64_t at_sample[1][3] = {};
+
+    // Triangles have a single flat color here, so shading a pixel once and storing the
+    // result to its covered samples is computing that color once per triangle.
+    const uint32_t color = pack_color(t.getColor());
+    const size_t plane = size_t(width) * height;
+
+    int64_t row[3] = {e.origin[0], e.origin[1], e.origin[2]};
+    for(int y = e.y0; y < e.y1; y++){
+        for(int x0 = e.x0; x0 < e.x1; x0 += SPAN_PIXELS){
+            int n = std::min(SPAN_PIXELS, e.x1 - x0);
+            size_t index = get_index(x0, y);
+            for (int j = 0; j < msaa_samples; ++j) {
+                int64_t w[3];
+                for (int i = 0; i < 3; ++i)
+                    w[i] = row[i] + (x0 - e.x0) * e.step_x[i] + offset[j][i];
+
+                float* depth = &sample_depth[j * plane + index];
+                uint64_t mask;
+                if (kernel) {
+                    int32_t w32[3] = {int32_t(w[0]), int32_t(w[1]), int32_t(w[2])};
+                    mask = kernel(s, w32, n, depth);
+                } else {
+                    mask = raster_span_wide(e, at_sample, 1, s, w, n, depth);
+                }
 
-    // std::cout << "min_x:" << min_x << ",max_x:" << max_x << std::endl; 
-    // std::cout << "min_y:" << min_y << ",max_y:" << max_y << std::endl; 
-    // iterate inside triangle
-    for(int x = min_x; x< max_x; x++){
-        for(int y=min_y; y<max_y; y++){
-            // Normal
-            // insideTriangle(x+0.5f, y+0.5f, t.v)
-            // MSAA
-            float fineness = 0;
-            //改为判断四个采样块的中心点在不在三角形内
-            if (insideTriangle((float)x + 0.25, (float)y + 0.25, t.v)) fineness += 0.25; 
-            if (insideTriangle((float)x + 0.25, (float)y + 0.75, t.v)) fineness += 0.25;
-            if (insideTriangle((float)x + 0.75, (float)y + 0.25, t.v)) fineness += 0.25;
-            if (insideTriangle((float)x + 0.75, (float)y + 0.75, t.v)) fineness += 0.25;
-            if(fineness!=0){
-                auto abg = computeBarycentric2D(x+0.5f,y+0.5f,t.v);
-                float alpha = std::get<0>(abg);
-                float beta = std::get<1>(abg);
-                float gamma = std::get<2>(abg);
-
-                float w_reciprocal = 1.0/(alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
-                float z_interpolated = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
-                z_interpolated *= w_reciprocal;
-
-                //判断当前z值是否小于原来z表此位置的z值
-                if(z_interpolated < depth_buf[get_index(x,y)]) {
-                    Eigen::Vector3f p = {(float)x,(float)y,z_interpolated};
-                    // set_pixel(p,t.getColor());
-                    set_pixel(p, fineness * t.getColor());
-                    depth_buf[get_index(x,y)] = z_interpolated; // update z
+                uint32_t* samples = &sample_color[j * plane + index];
+                while (mask) {
+                    samples[__builtin_ctzll(mask)] = color;
+                    mask &= mask - 1;
                 }
             }
         }
+        for (int i = 0; i < 3; ++i)
+            row[i] += e.step_y[i];
+    }
+}
+
+void rst::rasterizer::set_msaa(int samples)
+{
+    msaa_samples = samples >= 8 ? 8 : samples >= 4 ? 4 : samples >= 2 ? 2 : 1;
+    if (msaa_samples == 1)
+    {
+        std::vector<float>().swap(sample_depth);
+        std::vector<uint32_t>().swap(sample_color);
+        return;
     }
+    size_t count = size_t(width) * height * msaa_samples;
+    sample_depth.assign(count, std::numeric_limits<float>::infinity());
+    sample_color.assign(count, 0);
+    sample_depth.shrink_to_fit();
+    sample_color.shrink_to_fit();
+}
+
+void rst::rasterizer::resolve()
+{
+    if (msaa_samples == 1)
+        return;
+
+    const size_t plane = size_t(width) * height;
+    const float scale = 1.0f / msaa_samples;
+    // Sums go through a block of pixels one sample plane at a time, so every plane is
+    // read sequentially. Each channel sums into its own 21 bit field of one integer.
+    auto resolve_pixels = [&](size_t begin, size_t end) {
+        constexpr size_t BLOCK = 256;
+        uint64_t sum[BLOCK];
+        for (size_t p0 = begin; p0 < end; p0 += BLOCK)
+        {
+            size_t n = std::min(BLOCK, end - p0);
+            std::fill(sum, sum + n, 0);
+            for (int j = 0; j < msaa_samples; ++j)
+            {
+                const uint32_t* c = &sample_color[j * plane + p0];
+                for (size_t i = 0; i < n; ++i)
+                    sum[i] += (c[i] & 0xff) | uint64_t(c[i] & 0xff00) << 13 | uint64_t(c[i] & 0xff0000) << 26;
+            }
+            for (size_t i = 0; i < n; ++i)
+                frame_buf[p0 + i] = Eigen::Vector3f(float(sum[i] & 0x1fffff), float((sum[i] >> 21) & 0x1fffff),
+                                                    float(sum[i] >> 42)) * scale;
+        }
+    };
+
+    // whole rows per job
+    int jobs = pool ? std::min(pool->size(), height) : 1;
+    if (jobs <= 1)
+        return resolve_pixels(0, plane);
+    pool->parallel_for(jobs, [&](int k) {
+        resolve_pixels(size_t(height * k / jobs) * width, size_t(height * (k + 1) / jobs) * width);
+    });
+}
+
+void rst::rasterizer::set_resolve_threads(int n)
+{
+    pool = n > 1 ? std::make_unique<ThreadPool>(n) : nullptr;
 }
 
 void rst::rasterizer::set_model(const Eigen::Matrix4f& m)
@@ -193,10 +446,12 @@ void rst::rasterizer::clear(rst::Buffers buff)
     if ((buff & rst::Buffers::Color) == rst::Buffers::Color)
     {
         std::fill(frame_buf.begin(), frame_buf.end(), Eigen::Vector3f{0, 0, 0});
+        std::fill(sample_color.begin(), sample_color.end(), 0);
     }
     if ((buff & rst::Buffers::Depth) == rst::Buffers::Depth)
     {
         std::fill(depth_buf.begin(), depth_buf.end(), std::numeric_limits<float>::infinity());
+        std::fill(sample_depth.begin(), sample_depth.end(), std::numeric_limits<float>::infinity());
     }
 }
 
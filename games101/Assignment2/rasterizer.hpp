@@ -6,8 +6,12 @@
 
 #include <eigen3/Eigen/Eigen>
 #include <algorithm>
+#include <cstdint>
+#include <memory>
 #include "global.hpp"
 #include "Triangle.hpp"
+#include "rasterizer_simd.hpp"
+#include "ThreadPool.hpp"
 using namespace Eigen;
 
 namespace rst
@@ -68,6 +72,25 @@ namespace rst
 
         void set_pixel(const Eigen::Vector3f& point, const Eigen::Vector3f& color);
 
+        // Coverage and depth test run 8 (AVX2) or 4 (SSE2) pixels at a time when the CPU
+        // supports it; false forces the scalar kernel. Output is identical either way.
+        void set_simd(bool enable) { span_fn = select_span_kernel(enable); }
+
+        // Multisample anti-aliasing with 2, 4 or 8 samples per pixel at the standard
+        // D3D sample positions; other counts round down to one of those. Each sample has
+        // its own depth and color, the triangle color is computed once per pixel and
+        // stored to the samples it covers. draw() only writes the samples: call resolve()
+        // before reading frame_buffer(). 1 (the default) renders straight into
+        // frame_buf, scaling each pixel's color by how much of a 2x2 grid it covers.
+        void set_msaa(int samples);
+        int msaa() const { return msaa_samples; }
+        // Averages the samples of every pixel into frame_buf, split over a pool of n
+        // threads that is started here and kept for every later resolve().
+        void set_resolve_threads(int n);
+        void resolve();
+        // Bytes held by the per-sample depth and color buffers, 0 without MSAA.
+        size_t sample_memory() const { return sample_depth.capacity() * sizeof(float) + sample_color.capacity() * sizeof(uint32_t); }
+
         void clear(Buffers buff);
 
         void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type);
@@ -78,6 +101,7 @@ namespace rst
         void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
 
         void rasterize_triangle(const Triangle& t);
+        void rasterize_triangle_msaa(const Triangle& t);
 
         // VERTEX SHADER -> MVP -> Clipping -> /.W -> VIEWPORT -> DRAWLINE/DRAWTRI -> FRAGSHADER
 
@@ -95,6 +119,17 @@ namespace rst
         std::vector<float> depth_buf;
         int get_index(int x, int y);
 
+        // Sample major: sample j of the pixel at get_index(x, y) is at j * width * height
+        // + get_index(x, y). Colors are packed 8 bit RGB, r in the low byte.
+        int msaa_samples = 1;
+        std::vector<float> sample_depth;
+        std::vector<uint32_t> sample_color;
+
+        span_kernel span_fn = select_span_kernel();
+
+        // Workers for resolve(), null when it runs on the calling thread only.
+        std::unique_ptr<ThreadPool> pool;
+
         int width, height;
 
         int next_id = 0;
@@ -0,0 +1,58 @@
+//
+// AVX2 span kernel, 8 pixels per step. This file is compiled with AVX2 enabled and
+// only called after select_span_kernel() checked the CPU supports it.
+//
+
+#include "rasterizer_simd.hpp"
+
+#if defined(RST_HAVE_AVX2)
+#include <immintrin.h>
+
+uint64_t rst::raster_span_avx2(const span_setup& s, const int32_t (&w)[3], int n, float* depth)
+{
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i e[3], step8[3], bias[PIXEL_SAMPLES][3];
+    for (int i = 0; i < 3; ++i)
+    {
+        // lanes past the end of the span may wrap around; they are masked off below
+        e[i] = _mm256_add_epi32(_mm256_set1_epi32(w[i]), _mm256_mullo_epi32(_mm256_set1_epi32(s.step_x[i]), lane));
+        step8[i] = _mm256_set1_epi32(int32_t(uint32_t(s.step_x[i]) * 8));
+        // E + sample >= bias  <=>  E > bias - 1 - sample
+        for (int j = 0; j < PIXEL_SAMPLES; ++j)
+            bias[j][i] = _mm256_set1_epi32(s.bias[i] - 1 - s.sample[j][i]);
+    }
+    const __m256 inv_area = _mm256_set1_ps(s.inv_area);
+    const __m256 z0 = _mm256_set1_ps(s.z[0]);
+    const __m256 z1 = _mm256_set1_ps(s.z[1]);
+    const __m256 z2 = _mm256_set1_ps(s.z[2]);
+
+    uint64_t result = 0;
+    for (int x = 0; x < n; x += 8)
+    {
+        __m256i covered = _mm256_setzero_si256();
+        for (int j = 0; j < PIXEL_SAMPLES; ++j)
+            covered = _mm256_or_si256(covered, _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(e[0], bias[j][0]), _mm256_cmpgt_epi32(e[1], bias[j][1])),
+                                                                _mm256_cmpgt_epi32(e[2], bias[j][2])));
+        covered = _mm256_and_si256(covered, _mm256_cmpgt_epi32(_mm256_set1_epi32(n - x), lane));
+
+        if (_mm256_movemask_ps(_mm256_castsi256_ps(covered)))
+        {
+            __m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(e[0]), inv_area);
+            __m256 beta = _mm256_mul_ps(_mm256_cvtepi32_ps(e[1]), inv_area);
+            __m256 gamma = _mm256_mul_ps(_mm256_cvtepi32_ps(e[2]), inv_area);
+            __m256 z = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(alpha, z0), _mm256_mul_ps(beta, z1)), _mm256_mul_ps(gamma, z2));
+
+            // masked load/store never touch depth entries of uncovered lanes
+            __m256 old = _mm256_maskload_ps(depth + x, covered);
+            __m256 pass = _mm256_and_ps(_mm256_cmp_ps(z, old, _CMP_LT_OQ), _mm256_castsi256_ps(covered));
+            _mm256_maskstore_ps(depth + x, _mm256_castps_si256(pass), z);
+
+            result |= uint64_t(_mm256_movemask_ps(pass)) << x;
+        }
+
+        for (int i = 0; i < 3; ++i)
+            e[i] = _mm256_add_epi32(e[i], step8[i]);
+    }
+    return result;
+}
+#endif
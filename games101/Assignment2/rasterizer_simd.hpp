@@ -0,0 +1,44 @@
+//
+// Span kernels: sample coverage, depth interpolation and depth test for a run of pixels.
+//
+
+#pragma once
+
+#include <cstdint>
+
+namespace rst
+{
+    // Longest run a span kernel handles in one call, one result bit per pixel.
+    constexpr int SPAN_PIXELS = 64;
+
+    // Coverage samples per pixel (the 2x2 grid at +-0.25 around the centre).
+    constexpr int PIXEL_SAMPLES = 4;
+
+    // Edge functions of one triangle in the 32-bit form the span kernels consume.
+    // Values are those at the pixel centre; sample[j][i] is added to reach sample j.
+    struct span_setup
+    {
+        int32_t step_x[3];                // E_i(x + 1, y) - E_i(x, y)
+        int32_t bias[3];                  // a sample is covered when E_i >= bias[i] for all i
+        int32_t sample[PIXEL_SAMPLES][3]; // E_i(sample j) - E_i(pixel centre)
+        float inv_area;                   // E_i * inv_area is the barycentric weight of vertex i
+        float z[3];                       // screen space depth of each vertex
+    };
+
+    // Tests n <= SPAN_PIXELS consecutive pixels of a row; w holds the centre edge values
+    // of the first one. A pixel passes when any of its samples is covered and the depth
+    // interpolated at its centre is below depth[i]; the depth of passing pixels is written
+    // back. Returns bit i set for every passing pixel i.
+    using span_kernel = uint64_t (*)(const span_setup& s, const int32_t (&w)[3], int n, float* depth);
+
+    uint64_t raster_span_scalar(const span_setup& s, const int32_t (&w)[3], int n, float* depth);
+#if defined(__SSE2__)
+    uint64_t raster_span_sse2(const span_setup& s, const int32_t (&w)[3], int n, float* depth);
+#endif
+#if defined(RST_HAVE_AVX2)
+    uint64_t raster_span_avx2(const span_setup& s, const int32_t (&w)[3], int n, float* depth);
+#endif
+
+    // Best kernel for the CPU we are running on (AVX2, then SSE2), or the scalar one.
+    span_kernel select_span_kernel(bool allow_simd = true);
+}
@@ -0,0 +1,107 @@
+//
+// Background image encoder: frames handed to write() are encoded and saved on worker
+// threads while the caller goes on rendering.
+//
+
+#ifndef RASTERIZER_IMAGEWRITER_H
+#define RASTERIZER_IMAGEWRITER_H
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class ImageWriter
+{
+public:
+    // write() blocks while max_pending images are already waiting, so a renderer that
+    // outpaces the encoders does not queue up every frame in memory.
+    explicit ImageWriter(int threads, size_t max_pending = 8) : max_pending(max_pending)
+    {
+        for (int i = 0; i < std::max(threads, 1); ++i)
+            workers.emplace_back([this] { worker_loop(); });
+    }
+
+    ~ImageWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (auto& w : workers)
+            w.join();
+    }
+
+    ImageWriter(const ImageWriter&) = delete;
+    ImageWriter& operator=(const ImageWriter&) = delete;
+
+    // Queues image, which must not be modified afterwards, for saving to path.
+    void write(std::string path, cv::Mat image)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        room.wait(lock, [this] { return queue.size() < max_pending; });
+        queue.emplace_back(std::move(path), std::move(image));
+        wake.notify_one();
+    }
+
+    // Blocks until every queued image has been written.
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return queue.empty() && busy == 0; });
+    }
+
+    // Images that could not be written and the time spent encoding, summed over the
+    // worker threads. Only meaningful after wait().
+    int failures() const { return failed; }
+    double encode_ms() const { return encode_time; }
+
+private:
+    void worker_loop()
+    {
+        for (;;)
+        {
+            std::pair<std::string, cv::Mat> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stop || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                job = std::move(queue.front());
+                queue.pop_front();
+                ++busy;
+            }
+            room.notify_one();
+
+            auto start = std::chrono::steady_clock::now();
+            bool ok = cv::imwrite(job.first, job.second);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            failed += !ok;
+            encode_time += ms;
+            if (--busy == 0 && queue.empty())
+                idle.notify_all();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    size_t max_pending;
+
+    std::mutex mutex;
+    std::condition_variable wake, room, idle;
+    std::deque<std::pair<std::string, cv::Mat>> queue;
+    int busy = 0;
+    int failed = 0;
+    double encode_time = 0;
+    bool stop = false;
+};
+
+#endif //RASTERIZER_IMAGEWRITER_H
@@ -0,0 +1,98 @@
+//
+// Read-only view of a whole file: mapped where mmap exists, read into memory otherwise.
+//
+
+#ifndef RASTERIZER_MAPPEDFILE_H
+#define RASTERIZER_MAPPEDFILE_H
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RST_HAVE_MMAP
+#endif
+
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef RST_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0;
+        size = ok ? size_t(st.st_size) : 0;
+        if (ok && size > 0)
+        {
+            mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = mapping != MAP_FAILED;
+            if (ok)
+                data = static_cast<const char*>(mapping);
+            else
+                mapping = nullptr;
+        }
+        ::close(fd);
+        return ok;
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+        return true;
+#endif
+    }
+
+    void close()
+    {
+#ifdef RST_HAVE_MMAP
+        if (mapping)
+            munmap(mapping, size);
+        mapping = nullptr;
+#else
+        buffer.clear();
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    // Hint that the file is read front to back once.
+    void advise_sequential()
+    {
+#ifdef RST_HAVE_MMAP
+        if (mapping)
+            madvise(mapping, size, MADV_SEQUENTIAL);
+#endif
+    }
+
+    const char* data = nullptr;
+    size_t size = 0;
+
+private:
+#ifdef RST_HAVE_MMAP
+    void* mapping = nullptr;
+#else
+    std::vector<char> buffer;
+#endif
+};
+
+#endif //RASTERIZER_MAPPEDFILE_H
@@ -0,0 +1,172 @@
+//
+// Indexed triangle mesh stored as one contiguous array per vertex attribute.
+//
+
+#include "Mesh.hpp"
+
+#include <cmath>
+
+void Mesh::optimize_vertex_cache()
+{
+    constexpr int CACHE_SIZE = 32;
+    constexpr float CACHE_DECAY_POWER = 1.5f;
+    constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+    constexpr float VALENCE_BOOST_SCALE = 2.0f;
+    constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+    size_t vertex_count = positions.size();
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0)
+        return;
+
+    // Triangles using each vertex. The first live[v] entries of a vertex's list are
+    // the triangles not emitted yet.
+    std::vector<uint32_t> first(vertex_count + 1, 0);
+    for (uint32_t v : indices)
+        first[v + 1]++;
+    for (size_t v = 0; v < vertex_count; ++v)
+        first[v + 1] += first[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> live(vertex_count, 0);
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        uint32_t v = indices[i];
+        adjacency[first[v] + live[v]++] = uint32_t(i / 3);
+    }
+
+    std::vector<int> cache_position(vertex_count, -1);
+    auto vertex_score = [&](uint32_t v) {
+        if (live[v] == 0)
+            return -1.0f;
+        float score = 0;
+        int p = cache_position[v];
+        if (p >= 0)
+        {
+            // the triangle just emitted gets a fixed score so its vertices are not
+            // preferred over the rest of the cache too strongly
+            if (p < 3)
+                score = LAST_TRIANGLE_SCORE;
+            else
+                score = std::pow(1.0f - float(p - 3) / (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        }
+        return score + VALENCE_BOOST_SCALE * std::pow(float(live[v]), -VALENCE_BOOST_POWER);
+    };
+
+    std::vector<float> score(vertex_count);
+    for (size_t v = 0; v < vertex_count; ++v)
+        score[v] = vertex_score(uint32_t(v));
+
+    std::vector<float> triangle_score(triangle_count);
+    std::vector<char> emitted(triangle_count, 0);
+    int64_t best = 0;
+    for (size_t t = 0; t < triangle_count; ++t)
+    {
+        triangle_score[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+        if (triangle_score[t] > triangle_score[best])
+            best = int64_t(t);
+    }
+
+    std::vector<uint32_t> reordered;
+    reordered.reserve(indices.size());
+    uint32_t cache[CACHE_SIZE + 3];
+    int cache_size = 0;
+    size_t scan = 0;
+
+    while (best >= 0)
+    {
+        const uint32_t* tri = &indices[3 * best];
+        emitted[best] = 1;
+        reordered.insert(reordered.end(), tri, tri + 3);
+
+        // drop the triangle from its vertices' live lists
+        for (int i = 0; i < 3; ++i)
+        {
+            uint32_t v = tri[i];
+            uint32_t* list = &adjacency[first[v]];
+            for (uint32_t j = 0; j < live[v]; ++j)
+            {
+                if (list[j] == uint32_t(best))
+                {
+                    std::swap(list[j], list[live[v] - 1]);
+                    break;
+                }
+            }
+            live[v]--;
+        }
+
+        // its vertices move to the front of the cache, the rest shift back
+        uint32_t next[CACHE_SIZE + 3];
+        int next_size = 0;
+        for (int i = 0; i < 3; ++i)
+            next[next_size++] = tri[i];
+        for (int i = 0; i < cache_size; ++i)
+        {
+            uint32_t v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                next[next_size++] = v;
+        }
+
+        for (int i = 0; i < next_size; ++i)
+        {
+            uint32_t v = next[i];
+            cache_position[v] = i < CACHE_SIZE ? i : -1;
+            score[v] = vertex_score(v);
+        }
+
+        // rescore the triangles touching the cache and pick the best of them
+        best = -1;
+        float best_score = -1;
+        for (int i = 0; i < next_size; ++i)
+        {
+            uint32_t v = next[i];
+            for (uint32_t j = 0; j < live[v]; ++j)
+            {
+                uint32_t t = adjacency[first[v] + j];
+                const uint32_t* tv = &indices[3 * t];
+                triangle_score[t] = score[tv[0]] + score[tv[1]] + score[tv[2]];
+                if (triangle_score[t] > best_score)
+                {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+
+        cache_size = std::min(next_size, CACHE_SIZE);
+        std::copy(next, next + cache_size, cache);
+
+        // nothing in the cache has triangles left: continue with the next one in order
+        if (best < 0)
+        {
+            while (scan < triangle_count && emitted[scan])
+                ++scan;
+            if (scan < triangle_count)
+                best = int64_t(scan);
+        }
+    }
+    indices.swap(reordered);
+
+    // Renumber vertices in the order the new index buffer first uses them.
+    std::vector<uint32_t> remap(vertex_count, UINT32_MAX);
+    uint32_t next_vertex = 0;
+    for (uint32_t& v : indices)
+    {
+        if (remap[v] == UINT32_MAX)
+            remap[v] = next_vertex++;
+        v = remap[v];
+    }
+
+    std::vector<Eigen::Vector3f> new_positions(next_vertex), new_normals(next_vertex);
+    std::vector<Eigen::Vector2f> new_tex_coords(next_vertex);
+    for (size_t v = 0; v < vertex_count; ++v)
+    {
+        if (remap[v] == UINT32_MAX)
+            continue;
+        new_positions[remap[v]] = positions[v];
+        new_normals[remap[v]] = normals[v];
+        new_tex_coords[remap[v]] = tex_coords[v];
+    }
+    positions.swap(new_positions);
+    normals.swap(new_normals);
+    tex_coords.swap(new_tex_coords);
+}
@@ -0,0 +1,74 @@
+//
+// Indexed triangle mesh stored as one contiguous array per vertex attribute.
+//
+
+#ifndef RASTERIZER_MESH_H
+#define RASTERIZER_MESH_H
+
+#include <eigen3/Eigen/Eigen>
+#include <cstdint>
+#include <vector>
+
+// Non-owning view of an indexed mesh, what rst::rasterizer::draw consumes. Vertex i
+// is positions[i], normals[i], tex_coords[i]; triangle t is indices[3t .. 3t+2].
+struct MeshView
+{
+    const Eigen::Vector3f* positions = nullptr;
+    const Eigen::Vector3f* normals = nullptr;
+    const Eigen::Vector2f* tex_coords = nullptr;
+    size_t vertex_count = 0;
+
+    const uint32_t* indices = nullptr;
+    size_t index_count = 0;
+
+    // Object space bounds of all vertices; an empty box disables frustum culling.
+    Eigen::AlignedBox3f bounds;
+
+    size_t triangle_count() const { return index_count / 3; }
+};
+
+class Mesh
+{
+public:
+    std::vector<Eigen::Vector3f> positions;
+    std::vector<Eigen::Vector3f> normals;
+    std::vector<Eigen::Vector2f> tex_coords;
+    std::vector<uint32_t> indices;
+    Eigen::AlignedBox3f bounds;
+
+    uint32_t add_vertex(const Eigen::Vector3f& p, const Eigen::Vector3f& n, const Eigen::Vector2f& uv)
+    {
+        positions.push_back(p);
+        normals.push_back(n);
+        tex_coords.push_back(uv);
+        bounds.extend(p);
+        return uint32_t(positions.size() - 1);
+    }
+
+    void add_triangle(uint32_t a, uint32_t b, uint32_t c)
+    {
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+
+    // Reorders triangles for a small post-transform vertex cache (Tom Forsyth's
+    // linear-speed optimizer, 32 entries), then renumbers vertices in first-use order
+    // so the vertex arrays are read front to back as well.
+    void optimize_vertex_cache();
+
+    MeshView view() const
+    {
+        MeshView v;
+        v.positions = positions.data();
+        v.normals = normals.data();
+        v.tex_coords = tex_coords.data();
+        v.vertex_count = positions.size();
+        v.indices = indices.data();
+        v.index_count = indices.size();
+        v.bounds = bounds;
+        return v;
+    }
+};
+
+#endif //RASTERIZER_MESH_H
@@ -0,0 +1,167 @@
+//
+// Binary mesh cache: a mesh saved in the exact layout MeshView reads, so later runs
+// map the file and draw from it without parsing or copying anything.
+//
+
+#include "MeshCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "ObjParser.hpp"
+
+static const char MESH_CACHE_MAGIC[8] = {'R', 'S', 'T', 'M', 'E', 'S', 'H', '\0'};
+
+static_assert(sizeof(Eigen::Vector3f) == 3 * sizeof(float) && sizeof(Eigen::Vector2f) == 2 * sizeof(float),
+              "the cache stores vertex attributes as packed floats");
+
+static uint64_t align_up(uint64_t offset)
+{
+    return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+}
+
+// Size and modification time of source, false when it does not exist.
+static bool source_stamp(const std::string& source, uint64_t& size, int64_t& mtime)
+{
+    std::error_code ec;
+    size = std::filesystem::file_size(source, ec);
+    if (ec)
+        return false;
+    auto time = std::filesystem::last_write_time(source, ec);
+    if (ec)
+        return false;
+    mtime = int64_t(time.time_since_epoch().count());
+    return true;
+}
+
+bool MappedMesh::open(const std::string& path, const std::string& source, uint32_t flags)
+{
+    mesh = MeshView();
+    if (!file.open(path) || file.size < sizeof(mesh_cache_header))
+        return false;
+
+    mesh_cache_header h;
+    std::memcpy(&h, file.data, sizeof(h));
+    if (std::memcmp(h.magic, MESH_CACHE_MAGIC, sizeof(h.magic)) != 0 || h.version != MESH_CACHE_VERSION ||
+        h.flags != flags)
+        return false;
+
+    if (!source.empty())
+    {
+        uint64_t size;
+        int64_t mtime;
+        if (!source_stamp(source, size, mtime) || size != h.source_size || mtime != h.source_mtime)
+            return false;
+    }
+
+    // every array has to lie inside the file; the counts are bounded by the file size
+    // first, so the byte sizes below cannot overflow
+    if (h.vertex_count > file.size / sizeof(Eigen::Vector3f) || h.index_count > file.size / sizeof(uint32_t) ||
+        h.index_count % 3 != 0)
+        return false;
+    auto fits = [&](uint64_t offset, uint64_t bytes) {
+        return offset % MESH_CACHE_ALIGNMENT == 0 && offset <= file.size && bytes <= file.size - offset;
+    };
+    if (!fits(h.positions_offset, h.vertex_count * sizeof(Eigen::Vector3f)) ||
+        !fits(h.normals_offset, h.vertex_count * sizeof(Eigen::Vector3f)) ||
+        !fits(h.tex_coords_offset, h.vertex_count * sizeof(Eigen::Vector2f)) ||
+        !fits(h.indices_offset, h.index_count * sizeof(uint32_t)))
+        return false;
+
+    mesh.positions = reinterpret_cast<const Eigen::Vector3f*>(file.data + h.positions_offset);
+    mesh.normals = reinterpret_cast<const Eigen::Vector3f*>(file.data + h.normals_offset);
+    mesh.tex_coords = reinterpret_cast<const Eigen::Vector2f*>(file.data + h.tex_coords_offset);
+    mesh.vertex_count = h.vertex_count;
+    mesh.indices = reinterpret_cast<const uint32_t*>(file.data + h.indices_offset);
+    mesh.index_count = h.index_count;
+    // The raster code indexes the vertex arrays without checks; a corrupt file that
+    // still has the right stamp must not get that far.
+    for (size_t i = 0; i < mesh.index_count; ++i)
+    {
+        if (mesh.indices[i] >= h.vertex_count)
+        {
+            mesh = MeshView();
+            return false;
+        }
+    }
+    if (h.vertex_count > 0)
+        mesh.bounds = Eigen::AlignedBox3f(Eigen::Vector3f(h.bounds_min), Eigen::Vector3f(h.bounds_max));
+    return true;
+}
+
+void MappedMesh::adopt(Mesh&& parsed)
+{
+    file.close();
+    owned = std::move(parsed);
+    mesh = owned.view();
+}
+
+bool write_mesh_cache(const std::string& path, const Mesh& mesh, const std::string& source, uint32_t flags)
+{
+    mesh_cache_header h = {};
+    std::memcpy(h.magic, MESH_CACHE_MAGIC, sizeof(h.magic));
+    h.version = MESH_CACHE_VERSION;
+    h.flags = flags;
+    if (!source_stamp(source, h.source_size, h.source_mtime))
+        return false;
+    h.vertex_count = mesh.positions.size();
+    h.index_count = mesh.indices.size();
+    if (!mesh.bounds.isEmpty())
+    {
+        Eigen::Map<Eigen::Vector3f>(h.bounds_min) = mesh.bounds.min();
+        Eigen::Map<Eigen::Vector3f>(h.bounds_max) = mesh.bounds.max();
+    }
+
+    h.positions_offset = align_up(sizeof(h));
+    h.normals_offset = align_up(h.positions_offset + h.vertex_count * sizeof(Eigen::Vector3f));
+    h.tex_coords_offset = align_up(h.normals_offset + h.vertex_count * sizeof(Eigen::Vector3f));
+    h.indices_offset = align_up(h.tex_coords_offset + h.vertex_count * sizeof(Eigen::Vector2f));
+
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        auto write_at = [&](uint64_t offset, const void* data, size_t bytes) {
+            // pad up to the aligned start of the next block
+            static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+            out.write(zeros, std::streamsize(offset - uint64_t(out.tellp())));
+            out.write(static_cast<const char*>(data), std::streamsize(bytes));
+        };
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        write_at(h.positions_offset, mesh.positions.data(), mesh.positions.size() * sizeof(Eigen::Vector3f));
+        write_at(h.normals_offset, mesh.normals.data(), mesh.normals.size() * sizeof(Eigen::Vector3f));
+        write_at(h.tex_coords_offset, mesh.tex_coords.data(), mesh.tex_coords.size() * sizeof(Eigen::Vector2f));
+        write_at(h.indices_offset, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+        if (!out)
+        {
+            out.close();
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, path, ec);
+    if (ec)
+        std::filesystem::remove(temp, ec);
+    return !ec;
+}
+
+bool load_mesh_cached(const std::string& obj_path, const std::string& cache_path, MappedMesh& out,
+                      ThreadPool* pool, std::string* error, bool optimize_cache)
+{
+    uint32_t flags = optimize_cache ? 1 : 0;
+    if (out.open(cache_path, obj_path, flags))
+        return true;
+
+    Mesh mesh;
+    if (!load_obj(obj_path, mesh, pool, error, optimize_cache))
+        return false;
+    if (!write_mesh_cache(cache_path, mesh, obj_path, flags) || !out.open(cache_path, obj_path, flags))
+    {
+        // a read only or full directory only costs the next run another parse
+        if (error)
+            *error = cache_path + ": cannot write mesh cache, using the parsed mesh";
+        out.adopt(std::move(mesh));
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+//
+// Binary mesh cache: a mesh saved in the exact layout MeshView reads, so later runs
+// map the file and draw from it without parsing or copying anything.
+//
+
+#ifndef RASTERIZER_MESHCACHE_H
+#define RASTERIZER_MESHCACHE_H
+
+#include <cstdint>
+#include <string>
+#include "MappedFile.hpp"
+#include "Mesh.hpp"
+#include "ThreadPool.hpp"
+
+// File layout: mesh_cache_header, then the position, normal, tex_coord and index
+// arrays, each starting on a MESH_CACHE_ALIGNMENT boundary. Little endian only.
+constexpr uint32_t MESH_CACHE_VERSION = 1;
+constexpr size_t MESH_CACHE_ALIGNMENT = 64;
+
+struct mesh_cache_header
+{
+    char magic[8];              // "RSTMESH\0"
+    uint32_t version;           // MESH_CACHE_VERSION
+    uint32_t flags;             // caller defined, e.g. how the mesh was built; must match to reuse
+    uint64_t source_size;       // size and modification time of the file the mesh came from,
+    int64_t source_mtime;       // the cache is stale once either changes
+    uint64_t vertex_count;
+    uint64_t index_count;
+    float bounds_min[3];
+    float bounds_max[3];
+    uint64_t positions_offset;  // byte offsets from the start of the file
+    uint64_t normals_offset;
+    uint64_t tex_coords_offset;
+    uint64_t indices_offset;
+};
+
+// A cached mesh read straight from its mapping; view() points into the file. When no
+// cache could be written it holds the parsed mesh instead (see load_mesh_cached).
+class MappedMesh
+{
+public:
+    // Maps path and checks the header and that the indices form triangles of existing
+    // vertices. With a non-empty source, also checks that the cache was written for the
+    // current version of that file and with these flags.
+    bool open(const std::string& path, const std::string& source = "", uint32_t flags = 0);
+
+    // Draws from mesh itself rather than a mapping.
+    void adopt(Mesh&& mesh);
+
+    MeshView view() const { return mesh; }
+
+private:
+    MappedFile file;
+    Mesh owned;
+    MeshView mesh;
+};
+
+// Writes mesh to path (through a temporary file, so readers never see half of it),
+// stamped with the size and modification time of source.
+bool write_mesh_cache(const std::string& path, const Mesh& mesh, const std::string& source, uint32_t flags = 0);
+
+// Opens cache_path if it is up to date with obj_path. Otherwise loads obj_path with
+// load_obj, rewrites the cache and maps that. optimize_cache is passed to load_obj
+// and is part of what makes a cache up to date. The cache is optional: when it cannot
+// be written out holds the parsed mesh, error says why, and the result is still true.
+// Only a failure to load obj_path returns false.
+bool load_mesh_cached(const std::string& obj_path, const std::string& cache_path, MappedMesh& out,
+                      ThreadPool* pool = nullptr, std::string* error = nullptr, bool optimize_cache = false);
+
+#endif //RASTERIZER_MESHCACHE_H
@@ -19,6 +19,8 @@
 #include <fstream>
 #include <math.h>
 
+#include "ObjParser.hpp"
+
 // Print progress to console while loading (large models)
 #define OBJL_CONSOLE_OUTPUT
 
@@ -430,157 +432,87 @@ namespace objl
         //
         // If the file is unable to be found
         // or unable to be loaded return false
-        bool LoadFile(std::string Path)
+        //
+        // Parsing is done by parse_obj (ObjParser.hpp), in parallel
+        // when a pool is given; the results are then laid out as
+        // before: one Mesh per group, one Vertex per face corner.
+        bool LoadFile(std::string Path, ThreadPool* pool = nullptr)
         {
             // If the file is not an .obj file return false
             if (Path.substr(Path.size() - 4, 4) != ".obj")
                 return false;
 
-
-            std::ifstream file(Path);
-
-            if (!file.is_open())
+            ObjData data;
+            if (!parse_obj(Path, data, pool))
                 return false;
 
             LoadedMeshes.clear();
             LoadedVertices.clear();
             LoadedIndices.clear();
 
-            std::vector<Vector3> Positions;
-            std::vector<Vector2> TCoords;
-            std::vector<Vector3> Normals;
-
-            std::vector<Vertex> Vertices;
-            std::vector<unsigned int> Indices;
-
-            std::vector<std::string> MeshMatNames;
-
-            bool listening = false;
-            std::string meshname;
-
-            Mesh tempMesh;
-
+            // Load Materials, relative to the .obj file
+            std::string pathtomat = Path.substr(0, Path.find_last_of('/') + 1);
+            for (const std::string& lib : data.material_libs)
+            {
 #ifdef OBJL_CONSOLE_OUTPUT
-            const unsigned int outputEveryNth = 1000;
-            unsigned int outputIndicator = outputEveryNth;
+                std::cout << "- find materials in: " << pathtomat + lib << std::endl;
 #endif
+                LoadMaterials(pathtomat + lib);
+            }
 
-            std::string curline;
-            while (std::getline(file, curline))
+            for (const ObjGroup& group : data.groups)
             {
-#ifdef OBJL_CONSOLE_OUTPUT
-                if ((outputIndicator = ((outputIndicator + 1) % outputEveryNth)) == 1)
-                {
-                    if (!meshname.empty())
-                    {
-                        std::cout
-                                << "\r- " << meshname
-                                << "\t| vertices > " << Positions.size()
-                                << "\t| texcoords > " << TCoords.size()
-                                << "\t| normals > " << Normals.size()
-                                << "\t| triangles > " << (Vertices.size() / 3)
-                                << (!MeshMatNames.empty() ? "\t| material: " + MeshMatNames.back() : "");
-                    }
-                }
-#endif
+                std::vector<Vertex> Vertices;
+                std::vector<unsigned int> Indices;
+
+                // Per face, reused so faces do not allocate
+                std::vector<Vertex> vVerts;
+                std::vector<unsigned int> iIndices;
 
-                // Generate a Mesh Object or Prepare for an object to be created
-                if (algorithm::firstToken(curline) == "o" || algorithm::firstToken(curline) == "g" || curline[0] == 'g')
+                for (uint32_t f = group.first_face; f < group.first_face + group.face_count; f++)
                 {
-                    if (!listening)
+                    // Generate the vertices
+                    vVerts.clear();
+                    bool noNormal = false;
+                    for (uint32_t c = data.face_starts[f]; c < data.face_starts[f + 1]; c++)
                     {
-                        listening = true;
+                        const ObjCorner& corner = data.corners[c];
+                        const Eigen::Vector3f& p = data.positions[corner.position];
 
-                        if (algorithm::firstToken(curline) == "o" || algorithm::firstToken(curline) == "g")
+                        Vertex vVert;
+                        vVert.Position = Vector3(p.x(), p.y(), p.z());
+                        if (corner.tex_coord >= 0)
                         {
-                            meshname = algorithm::tail(curline);
+                            const Eigen::Vector2f& t = data.tex_coords[corner.tex_coord];
+                            vVert.TextureCoordinate = Vector2(t.x(), t.y());
+                        }
+                        if (corner.normal >= 0)
+                        {
+                            const Eigen::Vector3f& n = data.normals[corner.normal];
+                            vVert.Normal = Vector3(n.x(), n.y(), n.z());
                         }
                         else
                         {
-                            meshname = "unnamed";
+                            noNormal = true;
                         }
+                        vVerts.push_back(vVert);
                     }
-                    else
-                    {
-                        // Generate the mesh to put into the array
-
-                        if (!Indices.empty() && !Vertices.empty())
-                        {
-                            // Create Mesh
-                            tempMesh = Mesh(Vertices, Indices);
-                            tempMesh.MeshName = meshname;
+                    if (vVerts.size() < 3)
+                        continue;
 
-                            // Insert Mesh
-                            LoadedMeshes.push_back(tempMesh);
+                    // take care of missing normals
+                    if (noNormal)
+                    {
+                        Vector3 A = vVerts[0].Position - vVerts[1].Position;
+                        Vector3 B = vVerts[2].Position - vVerts[1].Position;
 
-                            // Cleanup
-                            Vertices.clear();
-                            Indices.clear();
-                            meshname.clear();
+                        Vector3 normal = math::CrossV3(A, B);
 
-                            meshname = algorithm::tail(curline);
-                        }
-                        else
+                        for (int i = 0; i < int(vVerts.size()); i++)
                         {
-                            if (algorithm::firstToken(curline) == "o" || algorithm::firstToken(curline) == "g")
-                            {
-                                meshname = algorithm::tail(curline);
-                            }
-                            else
-                            {
-                                meshname = "unnamed";
-                            }
+                            vVerts[i].Normal = normal;
                         }
                     }
-#ifdef OBJL_CONSOLE_OUTPUT
-                    std::cout << std::endl;
-                    outputIndicator = 0;
-#endif
-                }
-                // Generate a Vertex Position
-                if (algorithm::firstToken(curline) == "v")
-                {
-                    std::vector<std::string> spos;
-                    Vector3 vpos;
-                    algorithm::split(algorithm::tail(curline), spos, " ");
-
-                    vpos.X = std::stof(spos[0]);
-                    vpos.Y = std::stof(spos[1]);
-                    vpos.Z = std::stof(spos[2]);
-
-                    Positions.push_back(vpos);
-                }
-                // Generate a Vertex Texture Coordinate
-                if (algorithm::firstToken(curline) == "vt")
-                {
-                    std::vector<std::string> stex;
-                    Vector2 vtex;
-                    algorithm::split(algorithm::tail(curline), stex, " ");
-
-                    vtex.X = std::stof(stex[0]);
-                    vtex.Y = std::stof(stex[1]);
-
-                    TCoords.push_back(vtex);
-                }
-                // Generate a Vertex Normal;
-                if (algorithm::firstToken(curline) == "vn")
-                {
-                    std::vector<std::string> snor;
-                    Vector3 vnor;
-                    algorithm::split(algorithm::tail(curline), snor, " ");
-
-                    vnor.X = std::stof(snor[0]);
-                    vnor.Y = std::stof(snor[1]);
-                    vnor.Z = std::stof(snor[2]);
-
-                    Normals.push_back(vnor);
-                }
-                // Generate a Face (vertices & indices)
-                if (algorithm::firstToken(curline) == "f")
-                {
-                    // Generate the vertices
-                    std::vector<Vertex> vVerts;
-                    GenVerticesFromRawOBJ(vVerts, Positions, TCoords, Normals, curline);
 
                     // Add Vertices
                     for (int i = 0; i < int(vVerts.size()); i++)
@@ -590,8 +522,7 @@ namespace objl
                         LoadedVertices.push_back(vVerts[i]);
                     }
 
-                    std::vector<unsigned int> iIndices;
-
+                    iIndices.clear();
                     VertexTriangluation(iIndices, vVerts);
 
                     // Add Indices
@@ -602,106 +533,33 @@ namespace objl
 
                         indnum = (unsigned int)((LoadedVertices.size()) - vVerts.size()) + iIndices[i];
                         LoadedIndices.push_back(indnum);
-
                     }
                 }
-                // Get Mesh Material Name
-                if (algorithm::firstToken(curline) == "usemtl")
-                {
-                    MeshMatNames.push_back(algorithm::tail(curline));
-
-                    // Create new Mesh, if Material changes within a group
-                    if (!Indices.empty() && !Vertices.empty())
-                    {
-                        // Create Mesh
-                        tempMesh = Mesh(Vertices, Indices);
-                        tempMesh.MeshName = meshname;
-                        int i = 2;
-                        while(1) {
-                            tempMesh.MeshName = meshname + "_" + std::to_string(i);
-
-                            for (auto &m : LoadedMeshes)
-                                if (m.MeshName == tempMesh.MeshName)
-                                    continue;
-                            break;
-                        }
-
-                        // Insert Mesh
-                        LoadedMeshes.push_back(tempMesh);
-
-                        // Cleanup
-                        Vertices.clear();
-                        Indices.clear();
-                    }
-
-#ifdef OBJL_CONSOLE_OUTPUT
-                    outputIndicator = 0;
-#endif
-                }
-                // Load Materials
-                if (algorithm::firstToken(curline) == "mtllib")
-                {
-                    // Generate LoadedMaterial
-
-                    // Generate a path to the material file
-                    std::vector<std::string> temp;
-                    algorithm::split(Path, temp, "/");
 
-                    std::string pathtomat = "";
+                if (Indices.empty() || Vertices.empty())
+                    continue;
 
-                    if (temp.size() != 1)
-                    {
-                        for (int i = 0; i < temp.size() - 1; i++)
-                        {
-                            pathtomat += temp[i] + "/";
-                        }
-                    }
-
-
-                    pathtomat += algorithm::tail(curline);
-
-#ifdef OBJL_CONSOLE_OUTPUT
-                    std::cout << std::endl << "- find materials in: " << pathtomat << std::endl;
-#endif
-
-                    // Load Materials
-                    LoadMaterials(pathtomat);
-                }
-            }
-
-#ifdef OBJL_CONSOLE_OUTPUT
-            std::cout << std::endl;
-#endif
-
-            // Deal with last mesh
-
-            if (!Indices.empty() && !Vertices.empty())
-            {
                 // Create Mesh
-                tempMesh = Mesh(Vertices, Indices);
-                tempMesh.MeshName = meshname;
-
-                // Insert Mesh
-                LoadedMeshes.push_back(tempMesh);
-            }
-
-            file.close();
-
-            // Set Materials for each Mesh
-            for (int i = 0; i < MeshMatNames.size(); i++)
-            {
-                std::string matname = MeshMatNames[i];
+                Mesh tempMesh(Vertices, Indices);
+                tempMesh.MeshName = group.name;
+                // objl::Loader named every mesh a usemtl split off name_2 (its search for
+                // an unused suffix never got past the first try)
+                if (group.split_by_material)
+                    tempMesh.MeshName += "_2";
 
                 // Find corresponding material name in loaded materials
                 // when found copy material variables into mesh material
                 for (int j = 0; j < LoadedMaterials.size(); j++)
                 {
-                    if (LoadedMaterials[j].name == matname)
+                    if (LoadedMaterials[j].name == group.material)
                     {
-                        LoadedMeshes[i].MeshMaterial = LoadedMaterials[j];
+                        tempMesh.MeshMaterial = LoadedMaterials[j];
                         break;
                     }
                 }
+
+                // Insert Mesh
+                LoadedMeshes.push_back(tempMesh);
             }
 
             if (LoadedMeshes.empty() && LoadedVertices.empty() && LoadedIndices.empty())
@@ -724,129 +582,11 @@ namespace objl
         std::vector<Material> LoadedMaterials;
 
     private:
-        // Generate vertices from a list of positions,
-        //	tcoords, normals and a face line
-        void GenVerticesFromRawOBJ(std::vector<Vertex>& oVerts,
-                                   const std::vector<Vector3>& iPositions,
-                                   const std::vector<Vector2>& iTCoords,
-                                   const std::vector<Vector3>& iNormals,
-                                   std::string icurline)
-        {
-            std::vector<std::string> sface, svert;
-            Vertex vVert;
-            algorithm::split(algorithm::tail(icurline), sface, " ");
-
-            bool noNormal = false;
-
-            // For every given vertex do this
-            for (int i = 0; i < int(sface.size()); i++)
-            {
-                // See What type the vertex is.
-                int vtype;
-
-                algorithm::split(sface[i], svert, "/");
-
-                // Check for just position - v1
-                if (svert.size() == 1)
-                {
-                    // Only position
-                    vtype = 1;
-                }
-
-                // Check for position & texture - v1/vt1
-                if (svert.size() == 2)
-                {
-                    // Position & Texture
-                    vtype = 2;
-                }
-
-                // Check for Position, Texture and Normal - v1/vt1/vn1
-                // or if Position and Normal - v1//vn1
-                if (svert.size() == 3)
-                {
-                    if (svert[1] != "")
-                    {
-                        // Position, Texture, and Normal
-                        vtype = 4;
-                    }
-                    else
-                    {
-                        // Position & Normal
-                        vtype = 3;
-                    }
-                }
-
-                // Calculate and store the vertex
-                switch (vtype)
-                {
-                    case 1: // P
-                    {
-                        vVert.Position = algorithm::getElement(iPositions, svert[0]);
-                        vVert.TextureCoordinate = Vector2(0, 0);
-                        noNormal = true;
-                        oVerts.push_back(vVert);
-                        break;
-                    }
-                    case 2: // P/T
-                    {
-                        vVert.Position = algorithm::getElement(iPositions, svert[0]);
-                        vVert.TextureCoordinate = algorithm::getElement(iTCoords, svert[1]);
-                        noNormal = true;
-                        oVerts.push_back(vVert);
-                        break;
-                    }
-                    case 3: // P//N
-                    {
-                        vVert.Position = algorithm::getElement(iPositions, svert[0]);
-                        vVert.TextureCoordinate = Vector2(0, 0);
-                        vVert.Normal = algorithm::getElement(iNormals, svert[2]);
-                        oVerts.push_back(vVert);
-                        break;
-                    }
-                    case 4: // P/T/N
-                    {
-                        vVert.Position = algorithm::getElement(iPositions, svert[0]);
-                        vVert.TextureCoordinate = algorithm::getElement(iTCoords, svert[1]);
-                        vVert.Normal = algorithm::getElement(iNormals, svert[2]);
-                        oVerts.push_back(vVert);
-                        break;
-                    }
-                    default:
-                    {
-                        break;
-                    }
-                }
-            }
-
-            // take care of missing normals
-            // these may not be truly acurate but it is the
-            // best they get for not compiling a mesh with normals
-            if (noNormal)
-            {
-                Vector3 A = oVerts[0].Position - oVerts[1].Position;
-                Vector3 B = oVerts[2].Position - oVerts[1].Position;
-
-                Vector3 normal = math::CrossV3(A, B);
-
-                for (int i = 0; i < int(oVerts.size()); i++)
-                {
-                    oVerts[i].Normal = normal;
-                }
-            }
-        }
-
         // Triangulate a list of vertices into a face by printing
         //	inducies corresponding with triangles within it
         void VertexTriangluation(std::vector<unsigned int>& oIndices,
                                  const std::vector<Vertex>& iVerts)
         {
-            // If there are 2 or less verts,
-            // no triangle can be created,
-            // so exit
-            if (iVerts.size() < 3)
-            {
-                return;
-            }
             // If it is a triangle no need to calculate it
             if (iVerts.size() == 3)
             {
@@ -856,154 +596,18 @@ namespace objl
                 return;
             }
 
-            // Create a list of vertices
-            std::vector<Vertex> tVerts = iVerts;
-
-            while (true)
-            {
-                // For every vertex
-                for (int i = 0; i < int(tVerts.size()); i++)
-                {
-                    // pPrev = the previous vertex in the list
-                    Vertex pPrev;
-                    if (i == 0)
-                    {
-                        pPrev = tVerts[tVerts.size() - 1];
-                    }
-                    else
-                    {
-                        pPrev = tVerts[i - 1];
-                    }
-
-                    // pCur = the current vertex;
-                    Vertex pCur = tVerts[i];
-
-                    // pNext = the next vertex in the list
-                    Vertex pNext;
-                    if (i == tVerts.size() - 1)
-                    {
-                        pNext = tVerts[0];
-                    }
-                    else
-                    {
-                        pNext = tVerts[i + 1];
-                    }
-
-                    // Check to see if there are only 3 verts left
-                    // if so this is the last triangle
-                    if (tVerts.size() == 3)
-                    {
-                        // Create a triangle from pCur, pPrev, pNext
-                        for (int j = 0; j < int(tVerts.size()); j++)
-                        {
-                            if (iVerts[j].Position == pCur.Position)
-                                oIndices.push_back(j);
-                            if (iVerts[j].Position == pPrev.Position)
-                                oIndices.push_back(j);
-                            if (iVerts[j].Position == pNext.Position)
-                                oIndices.push_back(j);
-                        }
-
-                        tVerts.clear();
-                        break;
-                    }
-                    if (tVerts.size() == 4)
-                    {
-                        // Create a triangle from pCur, pPrev, pNext
-                        for (int j = 0; j < int(iVerts.size()); j++)
-                        {
-                            if (iVerts[j].Position == pCur.Position)
-                                oIndices.push_back(j);
-                            if (iVerts[j].Position == pPrev.Position)
-                                oIndices.push_back(j);
-                            if (iVerts[j].Position == pNext.Position)
-                                oIndices.push_back(j);
-                        }
-
-                        Vector3 tempVec;
-                        for (int j = 0; j < int(tVerts.size()); j++)
-                        {
-                            if (tVerts[j].Position != pCur.Position
-                                && tVerts[j].Position != pPrev.Position
-                                && tVerts[j].Position != pNext.Position)
-                            {
-                                tempVec = tVerts[j].Position;
-                                break;
-                            }
-                        }
-
-                        // Create a triangle from pCur, pPrev, pNext
-                        for (int j = 0; j < int(iVerts.size()); j++)
-                        {
-                            if (iVerts[j].Position == pPrev.Position)
-                                oIndices.push_back(j);
-                            if (iVerts[j].Position == pNext.Position)
-                                oIndices.push_back(j);
-                            if (iVerts[j].Position == tempVec)
-                                oIndices.push_back(j);
-                        }
-
-                        tVerts.clear();
-                        break;
-                    }
-
-                    // If Vertex is not an interior vertex
-                    float angle = math::AngleBetweenV3(pPrev.Position - pCur.Position, pNext.Position - pCur.Position) * (180 / 3.14159265359);
-                    if (angle <= 0 && angle >= 180)
-                        continue;
-
-                    // If any vertices are within this triangle
-                    bool inTri = false;
-                    for (int j = 0; j < int(iVerts.size()); j++)
-                    {
-                        if (algorithm::inTriangle(iVerts[j].Position, pPrev.Position, pCur.Position, pNext.Position)
-                            && iVerts[j].Position != pPrev.Position
-                            && iVerts[j].Position != pCur.Position
-                            && iVerts[j].Position != pNext.Position)
-                        {
-                            inTri = true;
-                            break;
-                        }
-                    }
-                    if (inTri)
-                        continue;
-
-                    // Create a triangle from pCur, pPrev, pNext
-                    for (int j = 0; j < int(iVerts.size()); j++)
-                    {
-                        if (iVerts[j].Position == pCur.Position)
-                            oIndices.push_back(j);
-                        if (iVerts[j].Position == pPrev.Position)
-                            oIndices.push_back(j);
-                        if (iVerts[j].Position == pNext.Position)
-                            oIndices.push_back(j);
-                    }
-
-                    // Delete pCur from the list
-                    for (int j = 0; j < int(tVerts.size()); j++)
-                    {
-                        if (tVerts[j].Position == pCur.Position)
-                        {
-                            tVerts.erase(tVerts.begin() + j);
-                            break;
-                        }
-                    }
-
-                    // reset i to the start
-                    // -1 since loop will add 1 to it
-                    i = -1;
-                }
-
-                // if no triangles were created
-                if (oIndices.size() == 0)
-                    break;
-
-                // if no more vertices
-                if (tVerts.size() == 0)
-                    break;
-            }
+            // Convex faces are fanned, concave ones ear clipped (see
+            // PolygonTriangulator); both reuse the buffers below
+            tPositions.clear();
+            for (const Vertex& v : iVerts)
+                tPositions.emplace_back(v.Position.X, v.Position.Y, v.Position.Z);
+            triangulator.triangulate(tPositions.data(), uint32_t(tPositions.size()), oIndices);
         }
 
+        // Scratch space for VertexTriangluation
+        PolygonTriangulator triangulator;
+        std::vector<Eigen::Vector3f> tPositions;
+
         // Load Materials from .mtl file
         bool LoadMaterials(std::string path)
         {
@@ -0,0 +1,678 @@
+//
+// Memory mapped, multi-threaded .obj parser.
+//
+
+#include "ObjParser.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#include "MappedFile.hpp"
+
+namespace
+{
+    // Group or material switch, at the chunk local face it applies from.
+    struct obj_event
+    {
+        uint32_t face;
+        bool material;
+        std::string name;
+    };
+
+    // What one chunk of the file parses to. Face indices are already 0-based and
+    // absolute, except negative (relative) references: those are stored relative to
+    // the first vertex of the chunk and listed in relative for fix-up once the
+    // vertex counts of earlier chunks are known.
+    struct obj_chunk
+    {
+        std::vector<Eigen::Vector3f> positions;
+        std::vector<Eigen::Vector3f> normals;
+        std::vector<Eigen::Vector2f> tex_coords;
+
+        std::vector<ObjCorner> corners;
+        std::vector<uint32_t> face_sizes;
+        std::vector<uint32_t> relative; // corner * 3 + attribute
+
+        std::vector<obj_event> events;
+        std::vector<std::string> material_libs;
+    };
+
+    int& corner_attribute(ObjCorner& c, int attribute)
+    {
+        return attribute == 0 ? c.position : attribute == 1 ? c.tex_coord : c.normal;
+    }
+
+    inline bool is_space(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline void skip_spaces(const char*& p, const char* end)
+    {
+        while (p < end && is_space(*p))
+            ++p;
+    }
+
+    inline bool is_digit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    // Decimal float without allocating or going through the locale. Exact for up to
+    // 19 significant digits and decimal exponents within +-22, which covers what
+    // exporters write; the rest goes through std::pow.
+    bool parse_float(const char*& p, const char* end, float& out)
+    {
+        static const double pow10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        skip_spaces(p, end);
+        const char* s = p;
+        bool negative = false;
+        if (s < end && (*s == '-' || *s == '+'))
+            negative = *s++ == '-';
+
+        uint64_t mantissa = 0;
+        int digits = 0, exponent = 0;
+        bool any = false;
+        for (; s < end && is_digit(*s); ++s, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*s - '0');
+                digits += mantissa != 0;
+            }
+            else
+                ++exponent;
+        }
+        if (s < end && *s == '.')
+        {
+            for (++s; s < end && is_digit(*s); ++s, any = true)
+            {
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*s - '0');
+                    digits += mantissa != 0;
+                    --exponent;
+                }
+            }
+        }
+        if (!any)
+            return false;
+
+        if (s < end && (*s == 'e' || *s == 'E'))
+        {
+            const char* e = s + 1;
+            bool exp_negative = false;
+            if (e < end && (*e == '-' || *e == '+'))
+                exp_negative = *e++ == '-';
+            if (e < end && is_digit(*e))
+            {
+                int value = 0;
+                for (; e < end && is_digit(*e); ++e)
+                    value = std::min(value * 10 + (*e - '0'), 100000);
+                exponent += exp_negative ? -value : value;
+                s = e;
+            }
+        }
+
+        double v = double(mantissa);
+        if (exponent >= 0 && exponent <= 22)
+            v *= pow10[exponent];
+        else if (exponent < 0 && exponent >= -22)
+            v /= pow10[-exponent];
+        else
+            v *= std::pow(10.0, exponent);
+
+        out = float(negative ? -v : v);
+        p = s;
+        return true;
+    }
+
+    bool parse_int(const char*& p, const char* end, int& out)
+    {
+        const char* s = p;
+        bool negative = false;
+        if (s < end && (*s == '-' || *s == '+'))
+            negative = *s++ == '-';
+        if (s >= end || !is_digit(*s))
+            return false;
+        int64_t value = 0;
+        for (; s < end && is_digit(*s); ++s)
+            value = std::min<int64_t>(value * 10 + (*s - '0'), INT32_MAX);
+        out = int(negative ? -value : value);
+        p = s;
+        return true;
+    }
+
+    // Rest of the line with surrounding white space removed.
+    std::string tail(const char* p, const char* end)
+    {
+        skip_spaces(p, end);
+        while (end > p && is_space(end[-1]))
+            --end;
+        return std::string(p, end);
+    }
+
+    bool starts_with_word(const char* p, const char* end, const char* word)
+    {
+        size_t n = std::strlen(word);
+        return size_t(end - p) > n && std::memcmp(p, word, n) == 0 && is_space(p[n]);
+    }
+
+    void parse_chunk(const char* p, const char* end, obj_chunk& c)
+    {
+        while (p < end)
+        {
+            const char* line_end = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!line_end)
+                line_end = end;
+
+            skip_spaces(p, line_end);
+            if (p + 1 < line_end)
+            {
+                switch (p[0])
+                {
+                    case 'v':
+                        if (is_space(p[1]))
+                        {
+                            const char* s = p + 1;
+                            Eigen::Vector3f v(0, 0, 0);
+                            parse_float(s, line_end, v.x()) && parse_float(s, line_end, v.y()) && parse_float(s, line_end, v.z());
+                            c.positions.push_back(v);
+                        }
+                        else if (p[1] == 'n' && p + 2 < line_end && is_space(p[2]))
+                        {
+                            const char* s = p + 2;
+                            Eigen::Vector3f n(0, 0, 0);
+                            parse_float(s, line_end, n.x()) && parse_float(s, line_end, n.y()) && parse_float(s, line_end, n.z());
+                            c.normals.push_back(n);
+                        }
+                        else if (p[1] == 't' && p + 2 < line_end && is_space(p[2]))
+                        {
+                            const char* s = p + 2;
+                            Eigen::Vector2f t(0, 0);
+                            parse_float(s, line_end, t.x()) && parse_float(s, line_end, t.y());
+                            c.tex_coords.push_back(t);
+                        }
+                        break;
+
+                    case 'f':
+                        if (is_space(p[1]))
+                        {
+                            const char* s = p + 1;
+                            int counts[] = {int(c.positions.size()), int(c.tex_coords.size()), int(c.normals.size())};
+                            uint32_t n = 0;
+                            for (;;)
+                            {
+                                skip_spaces(s, line_end);
+                                // v, v/vt, v//vn or v/vt/vn
+                                int value[3];
+                                bool present[3] = {false, false, false};
+                                present[0] = parse_int(s, line_end, value[0]);
+                                if (!present[0])
+                                    break;
+                                if (s < line_end && *s == '/')
+                                {
+                                    ++s;
+                                    present[1] = parse_int(s, line_end, value[1]);
+                                    if (s < line_end && *s == '/')
+                                    {
+                                        ++s;
+                                        present[2] = parse_int(s, line_end, value[2]);
+                                    }
+                                }
+                                // skip anything unparsable up to the next corner
+                                while (s < line_end && !is_space(*s))
+                                    ++s;
+
+                                ObjCorner corner;
+                                uint32_t slot = uint32_t(c.corners.size()) * 3;
+                                for (int a = 0; a < 3; ++a)
+                                {
+                                    int& index = corner_attribute(corner, a);
+                                    if (!present[a])
+                                        index = -1;
+                                    else if (value[a] > 0)
+                                        index = value[a] - 1;
+                                    else if (value[a] < 0)
+                                    {
+                                        index = counts[a] + value[a];
+                                        c.relative.push_back(slot + a);
+                                    }
+                                    else
+                                        index = INT32_MIN; // .obj indices start at 1
+                                }
+                                c.corners.push_back(corner);
+                                ++n;
+                            }
+                            c.face_sizes.push_back(n);
+                        }
+                        break;
+
+                    case 'o':
+                    case 'g':
+                        if (is_space(p[1]))
+                            c.events.push_back({uint32_t(c.face_sizes.size()), false, tail(p + 1, line_end)});
+                        break;
+
+                    case 'u':
+                        if (starts_with_word(p, line_end, "usemtl"))
+                            c.events.push_back({uint32_t(c.face_sizes.size()), true, tail(p + 6, line_end)});
+                        break;
+
+                    case 'm':
+                        if (starts_with_word(p, line_end, "mtllib"))
+                            c.material_libs.push_back(tail(p + 6, line_end));
+                        break;
+                }
+            }
+
+            p = line_end + 1;
+        }
+    }
+}
+
+// Polygons with more corners than this are ear clipped with the Morton ordered list.
+constexpr uint32_t TRIANGULATE_Z_ORDER_CORNERS = 64;
+
+void PolygonTriangulator::triangulate(const Eigen::Vector3f* points, uint32_t n, std::vector<uint32_t>& out)
+{
+    auto fan = [&] {
+        for (uint32_t k = 1; k + 1 < n; ++k)
+            out.insert(out.end(), {0, k, k + 1});
+    };
+    if (n <= 3)
+        return fan();
+
+    // Newell's normal is robust to collinear and slightly non planar corners. Dropping
+    // its largest axis projects the polygon to 2D without folding it; mirroring the
+    // second coordinate when that axis is negative makes the projection counter clockwise.
+    Eigen::Vector3f normal(0, 0, 0);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        const Eigen::Vector3f& a = points[i];
+        const Eigen::Vector3f& b = points[i + 1 < n ? i + 1 : 0];
+        normal += Eigen::Vector3f((a.y() - b.y()) * (a.z() + b.z()), (a.z() - b.z()) * (a.x() + b.x()),
+                                  (a.x() - b.x()) * (a.y() + b.y()));
+    }
+    int axis;
+    normal.cwiseAbs().maxCoeff(&axis);
+    if (normal[axis] == 0)
+        return fan(); // degenerate, any split is as good as another
+    int u = (axis + 1) % 3, v = (axis + 2) % 3;
+    float mirror = normal[axis] > 0 ? 1.0f : -1.0f;
+
+    projected.resize(n);
+    for (uint32_t i = 0; i < n; ++i)
+        projected[i] = Eigen::Vector2f(points[i][u], mirror * points[i][v]);
+
+    // Positive when a, b, c turn left.
+    auto turn = [&](uint32_t a, uint32_t b, uint32_t c) {
+        Eigen::Vector2f ab = projected[b] - projected[a], ac = projected[c] - projected[a];
+        return ab.x() * ac.y() - ab.y() * ac.x();
+    };
+
+    bool convex = true;
+    for (uint32_t i = 0; i < n && convex; ++i)
+        convex = turn(i > 0 ? i - 1 : n - 1, i, i + 1 < n ? i + 1 : 0) >= 0;
+    if (convex)
+        return fan();
+
+    prev.resize(n);
+    next.resize(n);
+    reflex.resize(n);
+    uint32_t reflex_count = 0;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        prev[i] = i > 0 ? i - 1 : n - 1;
+        next[i] = i + 1 < n ? i + 1 : 0;
+    }
+    // Reflex here includes collinear corners: neither can be clipped, and only they can
+    // lie inside an ear.
+    auto update_reflex = [&](uint32_t i) {
+        bool r = turn(prev[i], i, next[i]) <= 0;
+        reflex_count += int(r) - int(reflex[i]);
+        reflex[i] = r;
+    };
+    std::fill(reflex.begin(), reflex.end(), uint8_t(0));
+    for (uint32_t i = 0; i < n; ++i)
+        update_reflex(i);
+
+    // Large polygons also keep their remaining corners in a list sorted along a Morton
+    // curve over the polygon's bounds. Every corner inside an ear's bounding box has a
+    // code between those of the box corners, so the ear test only walks that stretch
+    // of the list instead of the whole ring.
+    bool z_order = n > TRIANGULATE_Z_ORDER_CORNERS;
+    Eigen::Vector2f z_min, z_scale;
+    auto z_code = [&](const Eigen::Vector2f& p) {
+        auto spread = [](uint32_t v) {
+            v = (v | (v << 8)) & 0x00FF00FF;
+            v = (v | (v << 4)) & 0x0F0F0F0F;
+            v = (v | (v << 2)) & 0x33333333;
+            return (v | (v << 1)) & 0x55555555;
+        };
+        Eigen::Vector2f q = ((p - z_min).cwiseProduct(z_scale)).cwiseMax(0.0f).cwiseMin(65535.0f);
+        return spread(uint32_t(q.x())) | (spread(uint32_t(q.y())) << 1);
+    };
+    if (z_order)
+    {
+        Eigen::AlignedBox2f box;
+        for (uint32_t i = 0; i < n; ++i)
+            box.extend(projected[i]);
+        z_min = box.min();
+        z_scale = (box.sizes().array() > 0).select(65535.0f / box.sizes().array(), 0.0f);
+
+        z.resize(n);
+        z_sorted.resize(n);
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            z[i] = z_code(projected[i]);
+            z_sorted[i] = i;
+        }
+        std::sort(z_sorted.begin(), z_sorted.end(), [&](uint32_t a, uint32_t b) { return z[a] < z[b]; });
+        prev_z.resize(n);
+        next_z.resize(n);
+        for (uint32_t k = 0; k < n; ++k)
+        {
+            prev_z[z_sorted[k]] = k > 0 ? z_sorted[k - 1] : UINT32_MAX;
+            next_z[z_sorted[k]] = k + 1 < n ? z_sorted[k + 1] : UINT32_MAX;
+        }
+    }
+
+    // Only a reflex corner can lie inside a convex corner's triangle.
+    auto blocks = [&](uint32_t a, uint32_t b, uint32_t c, uint32_t j) {
+        if (!reflex[j] || projected[j] == projected[a] || projected[j] == projected[b] || projected[j] == projected[c])
+            return false;
+        return turn(a, b, j) >= 0 && turn(b, c, j) >= 0 && turn(c, a, j) >= 0;
+    };
+    auto is_ear = [&](uint32_t a, uint32_t b, uint32_t c) {
+        if (reflex[b])
+            return false;
+        if (reflex_count == 0)
+            return true;
+        if (!z_order)
+        {
+            for (uint32_t j = next[c]; j != a; j = next[j])
+                if (blocks(a, b, c, j))
+                    return false;
+            return true;
+        }
+        Eigen::Vector2f lo = projected[a].cwiseMin(projected[b]).cwiseMin(projected[c]);
+        Eigen::Vector2f hi = projected[a].cwiseMax(projected[b]).cwiseMax(projected[c]);
+        uint32_t lo_z = z_code(lo), hi_z = z_code(hi);
+        auto in_box = [&](uint32_t j) {
+            return (projected[j].array() >= lo.array()).all() && (projected[j].array() <= hi.array()).all();
+        };
+        for (uint32_t j = next_z[b]; j != UINT32_MAX && z[j] <= hi_z; j = next_z[j])
+            if (j != a && j != c && in_box(j) && blocks(a, b, c, j))
+                return false;
+        for (uint32_t j = prev_z[b]; j != UINT32_MAX && z[j] >= lo_z; j = prev_z[j])
+            if (j != a && j != c && in_box(j) && blocks(a, b, c, j))
+                return false;
+        return true;
+    };
+
+    // Walk the ring clipping ears. A polygon that intersects itself may run out of
+    // ears; after a full lap without one the current corner is clipped anyway so the
+    // face still ends up with n - 2 triangles.
+    uint32_t remaining = n, i = 0, stalled = 0;
+    while (remaining > 3)
+    {
+        uint32_t a = prev[i], c = next[i];
+        if (stalled < remaining && !is_ear(a, i, c))
+        {
+            i = c;
+            ++stalled;
+            continue;
+        }
+        out.insert(out.end(), {a, i, c});
+        next[a] = c;
+        prev[c] = a;
+        if (z_order)
+        {
+            if (prev_z[i] != UINT32_MAX)
+                next_z[prev_z[i]] = next_z[i];
+            if (next_z[i] != UINT32_MAX)
+                prev_z[next_z[i]] = prev_z[i];
+        }
+        reflex_count -= reflex[i];
+        --remaining;
+        stalled = 0;
+        update_reflex(a);
+        update_reflex(c);
+        // Moving on past c rather than to it avoids fanning slivers from one corner.
+        i = next[c];
+    }
+    out.insert(out.end(), {prev[i], i, next[i]});
+}
+
+bool parse_obj(const std::string& path, ObjData& out, ThreadPool* pool, std::string* error)
+{
+    constexpr size_t MIN_CHUNK_BYTES = 256 * 1024;
+
+    auto fail = [&](const std::string& message) {
+        if (error)
+            *error = path + ": " + message;
+        return false;
+    };
+
+    MappedFile file;
+    if (!file.open(path))
+        return fail("cannot read file");
+    file.advise_sequential();
+
+    // Chunks start right after a newline so no line is split between two of them.
+    size_t chunk_count = pool ? std::min<size_t>(pool->size() * 4, file.size / MIN_CHUNK_BYTES + 1) : 1;
+    std::vector<size_t> bounds(chunk_count + 1, file.size);
+    bounds[0] = 0;
+    for (size_t i = 1; i < chunk_count; ++i)
+    {
+        size_t b = std::max(bounds[i - 1], file.size * i / chunk_count);
+        const void* nl = b < file.size ? std::memchr(file.data + b, '\n', file.size - b) : nullptr;
+        bounds[i] = nl ? static_cast<const char*>(nl) - file.data + 1 : file.size;
+    }
+
+    std::vector<obj_chunk> chunks(chunk_count);
+    auto parse = [&](int i) { parse_chunk(file.data + bounds[i], file.data + bounds[i + 1], chunks[i]); };
+    if (pool)
+        pool->parallel_for(int(chunk_count), parse);
+    else
+        parse(0);
+
+    // Where every chunk's output starts in the merged arrays.
+    struct offsets
+    {
+        size_t positions = 0, tex_coords = 0, normals = 0, corners = 0, faces = 0;
+    };
+    std::vector<offsets> start(chunk_count + 1);
+    for (size_t i = 0; i < chunk_count; ++i)
+    {
+        start[i + 1].positions = start[i].positions + chunks[i].positions.size();
+        start[i + 1].tex_coords = start[i].tex_coords + chunks[i].tex_coords.size();
+        start[i + 1].normals = start[i].normals + chunks[i].normals.size();
+        start[i + 1].corners = start[i].corners + chunks[i].corners.size();
+        start[i + 1].faces = start[i].faces + chunks[i].face_sizes.size();
+    }
+    const offsets& total = start[chunk_count];
+
+    out.positions.resize(total.positions);
+    out.tex_coords.resize(total.tex_coords);
+    out.normals.resize(total.normals);
+    out.corners.resize(total.corners);
+    out.face_starts.resize(total.faces + 1);
+    out.face_starts[total.faces] = uint32_t(total.corners);
+
+    std::atomic<bool> bad_index{false};
+    auto merge = [&](int i) {
+        obj_chunk& c = chunks[i];
+        const offsets& o = start[i];
+        std::copy(c.positions.begin(), c.positions.end(), out.positions.begin() + o.positions);
+        std::copy(c.tex_coords.begin(), c.tex_coords.end(), out.tex_coords.begin() + o.tex_coords);
+        std::copy(c.normals.begin(), c.normals.end(), out.normals.begin() + o.normals);
+
+        int base[] = {int(o.positions), int(o.tex_coords), int(o.normals)};
+        for (uint32_t slot : c.relative)
+            corner_attribute(c.corners[slot / 3], slot % 3) += base[slot % 3];
+
+        int limit[] = {int(total.positions), int(total.tex_coords), int(total.normals)};
+        for (const ObjCorner& corner : c.corners)
+        {
+            bad_index = bad_index || corner.position < 0 || corner.position >= limit[0] ||
+                        corner.tex_coord < -1 || corner.tex_coord >= limit[1] ||
+                        corner.normal < -1 || corner.normal >= limit[2];
+        }
+        std::copy(c.corners.begin(), c.corners.end(), out.corners.begin() + o.corners);
+
+        uint32_t first = uint32_t(o.corners);
+        for (size_t f = 0; f < c.face_sizes.size(); ++f)
+        {
+            out.face_starts[o.faces + f] = first;
+            first += c.face_sizes[f];
+        }
+    };
+    if (pool)
+        pool->parallel_for(int(chunk_count), merge);
+    else
+        merge(0);
+
+    if (bad_index)
+        return fail("face references a missing vertex");
+
+    // Replay group and material switches in file order.
+    out.groups.clear();
+    out.material_libs.clear();
+    ObjGroup group;
+    auto close_group = [&](uint32_t face, bool by_material) {
+        group.face_count = face - group.first_face;
+        group.split_by_material = by_material;
+        if (group.face_count > 0)
+            out.groups.push_back(group);
+        group.first_face = face;
+    };
+    for (size_t i = 0; i < chunk_count; ++i)
+    {
+        for (const obj_event& e : chunks[i].events)
+        {
+            uint32_t face = uint32_t(start[i].faces + e.face);
+            if (!e.material)
+            {
+                close_group(face, false);
+                group.name = e.name;
+            }
+            else
+            {
+                close_group(face, true);
+                group.material = e.name;
+            }
+        }
+        out.material_libs.insert(out.material_libs.end(), chunks[i].material_libs.begin(), chunks[i].material_libs.end());
+    }
+    close_group(uint32_t(total.faces), false);
+
+    return true;
+}
+
+void build_mesh(const ObjData& data, Mesh& mesh, bool optimize_cache)
+{
+    size_t triangles = 0;
+    for (size_t f = 0; f < data.face_count(); ++f)
+        triangles += std::max<int>(int(data.face_starts[f + 1] - data.face_starts[f]) - 2, 0);
+    mesh.indices.reserve(mesh.indices.size() + 3 * triangles);
+
+    // Open addressing table from a corner's (position, tex_coord, normal) triple to
+    // the mesh vertex made for it, so corners with the same triple share a vertex.
+    struct slot
+    {
+        ObjCorner key;
+        uint32_t vertex;
+    };
+    size_t capacity = 16;
+    while (capacity < 2 * data.corners.size())
+        capacity *= 2;
+    std::vector<slot> table(capacity, slot{{-1, -1, -1}, UINT32_MAX});
+    auto hash = [](const ObjCorner& c) {
+        uint64_t h = uint64_t(uint32_t(c.position)) * 0x9E3779B97F4A7C15ull;
+        h ^= (uint64_t(uint32_t(c.tex_coord)) + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2)) * 0xBF58476D1CE4E5B9ull;
+        h ^= (uint64_t(uint32_t(c.normal)) + 0x94D049BB133111EBull + (h << 6) + (h >> 2)) * 0x94D049BB133111EBull;
+        return size_t(h ^ (h >> 31));
+    };
+
+    PolygonTriangulator triangulator;
+    std::vector<Eigen::Vector3f> face_points;
+    std::vector<uint32_t> face_vertices, face_triangles;
+    for (size_t f = 0; f < data.face_count(); ++f)
+    {
+        const ObjCorner* c = &data.corners[data.face_starts[f]];
+        uint32_t n = data.face_starts[f + 1] - data.face_starts[f];
+        if (n < 3)
+            continue;
+
+        // Corners without a normal get the face normal. Their vertex then belongs to
+        // this face alone and is not shared.
+        Eigen::Vector3f face_normal(0, 0, 0);
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            if (c[i].normal < 0)
+            {
+                const auto& p = data.positions;
+                face_normal = (p[c[0].position] - p[c[1].position]).cross(p[c[2].position] - p[c[1].position]);
+                break;
+            }
+        }
+
+        face_vertices.clear();
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            auto add_vertex = [&] {
+                return mesh.add_vertex(data.positions[c[i].position],
+                                       c[i].normal >= 0 ? data.normals[c[i].normal] : face_normal,
+                                       c[i].tex_coord >= 0 ? data.tex_coords[c[i].tex_coord] : Eigen::Vector2f(0, 0));
+            };
+            if (c[i].normal < 0)
+            {
+                face_vertices.push_back(add_vertex());
+                continue;
+            }
+
+            size_t h = hash(c[i]) & (capacity - 1);
+            while (table[h].vertex != UINT32_MAX &&
+                   !(table[h].key.position == c[i].position && table[h].key.tex_coord == c[i].tex_coord &&
+                     table[h].key.normal == c[i].normal))
+                h = (h + 1) & (capacity - 1);
+            if (table[h].vertex == UINT32_MAX)
+                table[h] = {c[i], add_vertex()};
+            face_vertices.push_back(table[h].vertex);
+        }
+
+        face_triangles.clear();
+        if (n == 3)
+            face_triangles.insert(face_triangles.end(), {0, 1, 2});
+        else
+        {
+            face_points.clear();
+            for (uint32_t i = 0; i < n; ++i)
+                face_points.push_back(data.positions[c[i].position]);
+            triangulator.triangulate(face_points.data(), n, face_triangles);
+        }
+        for (size_t k = 0; k < face_triangles.size(); k += 3)
+            mesh.add_triangle(face_vertices[face_triangles[k]], face_vertices[face_triangles[k + 1]],
+                              face_vertices[face_triangles[k + 2]]);
+    }
+
+    if (optimize_cache)
+        mesh.optimize_vertex_cache();
+}
+
+bool load_obj(const std::string& path, Mesh& mesh, ThreadPool* pool, std::string* error, bool optimize_cache)
+{
+    ObjData data;
+    if (!parse_obj(path, data, pool, error))
+        return false;
+    build_mesh(data, mesh, optimize_cache);
+    return true;
+}
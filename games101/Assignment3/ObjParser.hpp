@@ -0,0 +1,83 @@
+//
+// Memory mapped, multi-threaded .obj parser.
+//
+
+#ifndef RASTERIZER_OBJPARSER_H
+#define RASTERIZER_OBJPARSER_H
+
+#include <eigen3/Eigen/Eigen>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Mesh.hpp"
+#include "ThreadPool.hpp"
+
+// One face corner: 0-based indices into the attribute pools, -1 when the face does
+// not reference that attribute.
+struct ObjCorner
+{
+    int position, tex_coord, normal;
+};
+
+// Run of faces sharing an object/group name and a material. A new group starts on
+// every o/g line and on every usemtl, the same places objl::Loader starts a new mesh.
+struct ObjGroup
+{
+    std::string name;
+    std::string material;
+    uint32_t first_face = 0;
+    uint32_t face_count = 0;
+    bool split_by_material = false; // ended by a usemtl rather than an o/g line or the end of the file
+};
+
+// Everything parse_obj reads from a file, still in the .obj layout of separate
+// attribute pools referenced by face corners.
+struct ObjData
+{
+    std::vector<Eigen::Vector3f> positions;
+    std::vector<Eigen::Vector3f> normals;
+    std::vector<Eigen::Vector2f> tex_coords;
+
+    std::vector<ObjCorner> corners;
+    std::vector<uint32_t> face_starts; // face f uses corners [face_starts[f], face_starts[f + 1])
+
+    std::vector<ObjGroup> groups;
+    std::vector<std::string> material_libs; // as written after mtllib
+
+    size_t face_count() const { return face_starts.empty() ? 0 : face_starts.size() - 1; }
+};
+
+// Splits polygons into triangles. Triangles and convex polygons are fanned from the
+// first corner; concave ones are ear clipped over a linked list of the remaining
+// corners. The buffers are kept between calls, so once they have grown to the
+// largest polygon nothing is allocated per face.
+class PolygonTriangulator
+{
+public:
+    // Appends the triangles of the polygon with corners points[0..n) to out as corner
+    // indices, in the polygon's own winding order.
+    void triangulate(const Eigen::Vector3f* points, uint32_t n, std::vector<uint32_t>& out);
+
+private:
+    std::vector<Eigen::Vector2f> projected; // corners in the polygon plane, counter clockwise
+    std::vector<uint32_t> prev, next;       // corners not clipped yet, as a ring
+    std::vector<uint8_t> reflex;
+    std::vector<uint32_t> z, z_sorted, prev_z, next_z; // Morton code and order, for large polygons
+};
+
+// Maps the file and parses newline aligned chunks of it on pool (serially without
+// one). Returns false, with a message in error, when the file cannot be read or a
+// face references a vertex that does not exist.
+bool parse_obj(const std::string& path, ObjData& out, ThreadPool* pool = nullptr, std::string* error = nullptr);
+
+// Appends the faces of data to mesh, split by PolygonTriangulator. Corners referencing the same
+// position/tex_coord/normal triple share one vertex; corners without a normal get the
+// face normal, like objl::Loader does. optimize_cache runs
+// Mesh::optimize_vertex_cache on the result (which covers the whole mesh).
+void build_mesh(const ObjData& data, Mesh& mesh, bool optimize_cache = false);
+
+// parse_obj followed by build_mesh.
+bool load_obj(const std::string& path, Mesh& mesh, ThreadPool* pool = nullptr, std::string* error = nullptr,
+              bool optimize_cache = false);
+
+#endif //RASTERIZER_OBJPARSER_H
@@ -0,0 +1,501 @@
+//
+// Camera matrices and shaders shared by the Rasterizer and RasterBenchmark programs.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Scene.hpp"
+
+Eigen::Matrix4f get_view_matrix(Eigen::Vector3f eye_pos)
+{
+    Eigen::Matrix4f view = Eigen::Matrix4f::Identity();
+
+    Eigen::Matrix4f translate;
+    translate << 1,0,0,-eye_pos[0],
+                 0,1,0,-eye_pos[1],
+                 0,0,1,-eye_pos[2],
+                 0,0,0,1;
+
+    view = translate*view;
+
+    return view;
+}
+
+Eigen::Matrix4f get_model_matrix(float angle)
+{
+    Eigen::Matrix4f rotation;
+    angle = angle * MY_PI / 180.f;
+    rotation << cos(angle), 0, sin(angle), 0,
+                0, 1, 0, 0,
+                -sin(angle), 0, cos(angle), 0,
+                0, 0, 0, 1;
+
+    Eigen::Matrix4f scale;
+    scale << 2.5, 0, 0, 0,
+              0, 2.5, 0, 0,
+              0, 0, 2.5, 0,
+              0, 0, 0, 1;
+
+    Eigen::Matrix4f translate;
+    translate << 1, 0, 0, 0,
+            0, 1, 0, 0,
+            0, 0, 1, 0,
+            0, 0, 0, 1;
+
+    return translate * rotation * scale;
+}
+
+Eigen::Matrix4f get_projection_matrix(float eye_fov, float aspect_ratio, float zNear, float zFar)
+{
+    // TODO: Use the same projection matrix from the previous assignments
+    Eigen::Matrix4f projection = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f M_trans;
+    Eigen::Matrix4f M_persp;
+    Eigen::Matrix4f M_ortho;
+    
+    float angle = 0.5 * eye_fov * M_PI / 180.0f;
+    // The camera looks down -z, so the planes sit at view z n = -zNear and f = -zFar.
+    float n = -zNear;
+    float f = -zFar;
+    M_persp << 
+               n, 0, 0, 0,
+               0, n, 0, 0,
+               0, 0, n + f, -n*f,
+               0, 0, 1, 0;
+               
+    float yTop = zNear * tan(angle);
+    float yBottom = -yTop;
+    float xRight = yTop * aspect_ratio;
+    float xLeft = - xRight;
+
+    // [f, n] goes to ndc z [1, -1]: the rasterizer keeps the smaller depth.
+    M_trans <<
+        1, 0, 0, -(xLeft + xRight) / 2,
+        0, 1, 0, -(yTop + yBottom) / 2,
+        0, 0, 1, -(n + f) / 2,
+        0, 0, 0, 1;
+    M_ortho <<
+        2 / (xRight - xLeft), 0, 0, 0,
+        0, 2 / (yTop - yBottom), 0, 0,
+        0, 0, 2 / (f - n), 0,
+        0, 0, 0, 1;
+
+    M_ortho = M_ortho * M_trans;
+    projection = M_ortho * M_persp * projection;
+
+    return projection;
+}
+
+Eigen::Vector3f vertex_shader(const vertex_shader_payload& payload)
+{
+    return payload.position;
+}
+
+Eigen::Vector3f normal_fragment_shader(const fragment_shader_payload& payload)
+{
+    Eigen::Vector3f return_color = (payload.normal.head<3>().normalized() + Eigen::Vector3f(1.0f, 1.0f, 1.0f)) / 2.f;
+    Eigen::Vector3f result;
+    result << return_color.x() * 255, return_color.y() * 255, return_color.z() * 255;
+    return result;
+}
+
+static Eigen::Vector3f reflect(const Eigen::Vector3f& vec, const Eigen::Vector3f& axis)
+{
+    auto costheta = vec.dot(axis);
+    return (2 * costheta * axis - vec).normalized();
+}
+
+Eigen::Vector3f texture_fragment_shader(const fragment_shader_payload& payload)
+{
+    Eigen::Vector3f return_color = {0, 0, 0};
+    if (payload.texture)
+    {
+        // TODO: Get the texture value at the texture coordinates of the current fragment
+        return_color = payload.texture -> getColorTrilinear(payload.tex_coords.x(), payload.tex_coords.y(), payload.tex_coords_dx, payload.tex_coords_dy);
+    }
+    Eigen::Vector3f texture_color;
+    texture_color << return_color.x(), return_color.y(), return_color.z();
+
+    const shader_uniforms& uni = *payload.uniforms;
+    Eigen::Vector3f kd = texture_color / 255.f;
+
+    Eigen::Vector3f color = texture_color;
+    Eigen::Vector3f point = payload.view_pos;
+    Eigen::Vector3f normal = payload.normal;
+
+    Eigen::Vector3f result_color = {0, 0, 0};
+
+    Eigen::Vector3f n = normal.normalized();
+    Eigen::Vector3f v = uni.eye_pos - point; //v为出射光方向（指向眼睛）
+    for (int i = 0; i < uni.light_count; ++i)
+    {
+        // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
+        // components are. Then, accumulate that result on the *result_color* object.
+        const light& light = uni.lights[i];
+        auto l = light.position - point; //l为指向入射光源方向
+        auto h = (v + l).normalized(); //h为半程向量即v+l归一化后的单位向量
+        auto r = l.dot(l); //衰减因子
+        auto diffuse = kd.cwiseProduct(light.intensity / r) * std::max(0.0f, n.dot(l.normalized()));
+        auto specular = uni.ks.cwiseProduct(light.intensity / r) * std::pow(std::max(0.0f, n.dot(h)), uni.p);
+        result_color += (uni.ambient + diffuse + specular);
+    }
+
+    return result_color * 255.f;
+}
+
+Eigen::Vector3f phong_fragment_shader(const fragment_shader_payload& payload)
+{
+    const shader_uniforms& uni = *payload.uniforms;
+    Eigen::Vector3f kd = payload.color;
+
+    Eigen::Vector3f color = payload.color;
+    Eigen::Vector3f point = payload.view_pos;
+    Eigen::Vector3f normal = payload.normal;
+
+    Eigen::Vector3f result_color = {0, 0, 0};
+    Eigen::Vector3f n = normal.normalized();
+    Eigen::Vector3f v = uni.eye_pos - point;
+    for (int i = 0; i < uni.light_count; ++i)
+    {
+        // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
+        // components are. Then, accumulate that result on the *result_color* object.
+        const light& light = uni.lights[i];
+        auto l = light.position - point; //l为指向入射光源方向
+        auto r = l.dot(l); //衰减因子
+
+        auto diffuse = kd.cwiseProduct(light.intensity / r) * std::max(0.0f, n.dot(l.normalized()));
+
+        auto h = (v + l).normalized(); //h为半程向量即v+l归一化后的单位向量
+
+        auto specular = uni.ks.cwiseProduct(light.intensity / r) * std::pow(std::max(0.0f, n.dot(h)), uni.p);
+
+        result_color += (uni.ambient + diffuse + specular); // uni.ambient: 环境光
+    }
+
+    return result_color * 255.f;
+}
+
+
+
+Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload& payload)
+{
+    
+    const shader_uniforms& uni = *payload.uniforms;
+    Eigen::Vector3f kd = payload.color;
+
+    Eigen::Vector3f color = payload.color; 
+    Eigen::Vector3f point = payload.view_pos;
+    Eigen::Vector3f normal = payload.normal;
+
+    float kh = 0.2, kn = 0.1;
+    
+    // TODO: Implement displacement mapping here
+    // Let n = normal = (x, y, z)
+    // Vector t = (x*y/sqrt(x*x+z*z),sqrt(x*x+z*z),z*y/sqrt(x*x+z*z))
+    // Vector b = n cross product t
+    // Matrix TBN = [t b n]
+    // dU = kh * kn * (h(u+1/w,v)-h(u,v))
+    // dV = kh * kn * (h(u,v+1/h)-h(u,v))
+    // Vector ln = (-dU, -dV, 1)
+    // Position p = p + kn * n * h(u,v)
+    // Normal n = normalize(TBN * ln)
+
+    auto x = normal.x();
+    auto y = normal.y();
+    auto z = normal.z();
+    Eigen::Vector3f t(x * y / sqrt(x * x + z * z), sqrt(x * x + z * z), z * y / sqrt(x * x + z * z));
+    Eigen::Vector3f b = normal.cross(t);
+    Eigen::Matrix3f TBN; //TBN矩阵: 将纹理坐标对应到模型空间中
+    TBN <<
+        t.x(), b.x(), normal.x(),
+        t.y(), b.y(), normal.y(),
+        t.z(), b.z(), normal.z();
+
+    auto u = payload.tex_coords.x();
+    auto v = payload.tex_coords.y();
+    auto w = payload.texture->width;
+    auto h = payload.texture->height;
+
+    auto dU = kh * kn * (payload.texture->getColor(u + 1.0f / w, v).norm() - payload.texture->getColor(u, v).norm());
+    auto dV = kh * kn * (payload.texture->getColor(u, v + 1.0f / h).norm() - payload.texture->getColor(u, v).norm());
+
+    Eigen::Vector3f ln{ -dU,-dV,1.0f };
+    point += (kn * normal * payload.texture->getColor(u, v).norm()); //
+    normal = TBN * ln;
+    normal.normalized();
+
+    Eigen::Vector3f result_color = {0, 0, 0};
+
+    Eigen::Vector3f n = normal.normalized();
+    Eigen::Vector3f view_dir = uni.eye_pos - point; //出射光方向（指向眼睛）
+    for (int i = 0; i < uni.light_count; ++i)
+    {
+        // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
+        // components are. Then, accumulate that result on the *result_color* object.
+        const light& light = uni.lights[i];
+        auto l = light.position - point; //l为指向入射光源方向
+        auto half = (view_dir + l).normalized(); //h为半程向量即v+l归一化后的单位向量
+        auto r = l.dot(l); //衰减因子
+        auto diffuse = kd.cwiseProduct(light.intensity / r) * std::max(0.0f, n.dot(l.normalized()));
+        auto specular = uni.ks.cwiseProduct(light.intensity / r) * std::pow(std::max(0.0f, n.dot(half)), uni.p);
+        result_color += (uni.ambient + diffuse + specular);
+    }
+
+    return result_color * 255.f;
+}
+
+
+Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload& payload)
+{
+    
+    Eigen::Vector3f kd = payload.color;
+
+    Eigen::Vector3f color = payload.color; 
+    Eigen::Vector3f point = payload.view_pos;
+    Eigen::Vector3f normal = payload.normal;
+
+
+    float kh = 0.2, kn = 0.1;
+
+    // TODO: Implement bump mapping here
+    // Let n = normal = (x, y, z)
+    // Vector t = (x*y/sqrt(x*x+z*z),sqrt(x*x+z*z),z*y/sqrt(x*x+z*z))
+    // Vector b = n cross product t
+    // Matrix TBN = [t b n]
+    // dU = kh * kn * (h(u+1/w,v)-h(u,v))
+    // dV = kh * kn * (h(u,v+1/h)-h(u,v))
+    // Vector ln = (-dU, -dV, 1)
+    // Normal n = normalize(TBN * ln)
+    auto x = normal.x();
+    auto y = normal.y();
+    auto z = normal.z();
+
+    Eigen::Vector3f t(x * y / sqrt(x * x + z * z), sqrt(x*x+z*z),z*y/sqrt(x*x+z*z));
+    Eigen::Vector3f b = normal.cross(t);
+    Eigen::Matrix3f TBN;
+    TBN << 
+        t.x(), b.x(), normal.x(),
+        t.y(), b.y(), normal.y(),
+        t.z(), b.z(), normal.z();
+
+    auto u = payload.tex_coords.x();
+    auto v = payload.tex_coords.y();
+    auto w = payload.texture->width;
+    auto h = payload.texture->height;
+
+    auto dU = kh * kn * (payload.texture->getColor(u + 1.0f / w, v).norm() - payload.texture->getColor(u, v).norm());
+    auto dV = kh * kn * (payload.texture->getColor(u, v + 1.0f / h).norm() - payload.texture->getColor(u, v).norm());
+
+    Eigen::Vector3f ln{ -dU,-dV,1.0f };
+    normal = TBN * ln;
+    Eigen::Vector3f result_color = normal.normalized();
+
+    // Eigen::Vector3f result_color = {0, 0, 0};
+    // result_color = normal;
+
+    return result_color * 255.f;
+}
+
+// draw<Shader> instantiated for one of the shaders above, which it can inline as they
+// are defined in this file.
+template <Eigen::Vector3f (*shader)(const fragment_shader_payload&)>
+static void draw_with(rst::rasterizer& r, const MeshView& mesh)
+{
+    r.draw(mesh, [](const fragment_shader_payload& payload) { return shader(payload); });
+}
+
+// phong_fragment_shader over a batch of fragments. The payload fields it reads are
+// gathered into one array per component and each light is applied to the whole batch
+// in plain float loops the compiler can vectorize. The arithmetic is the scalar
+// shader's, in the same order, so the images are the same. Every payload of a batch
+// must share one uniform block, as those built by rst::rasterizer do.
+struct phong_batch_shader
+{
+    Eigen::Vector3f operator()(const fragment_shader_payload& payload) const { return phong_fragment_shader(payload); }
+
+    void shade_batch(const fragment_shader_payload* in, int count, Eigen::Vector3f* out) const
+    {
+        constexpr int BATCH = rst::SPAN_PIXELS;
+        for (int first = 0; first < count; first += BATCH)
+            shade(in + first, std::min(BATCH, count - first), out + first);
+    }
+
+private:
+    // a . b summed the way Eigen's Vector3f::dot does
+    static float dot(float ax, float ay, float az, float bx, float by, float bz)
+    {
+        return ax * bx + (ay * by + az * bz);
+    }
+
+    static void shade(const fragment_shader_payload* in, int n, Eigen::Vector3f* out)
+    {
+        constexpr int BATCH = rst::SPAN_PIXELS;
+        const shader_uniforms& uni = *in[0].uniforms;
+        float nx[BATCH], ny[BATCH], nz[BATCH];
+        float px[BATCH], py[BATCH], pz[BATCH];
+        float kr[BATCH], kg[BATCH], kb[BATCH];
+        float rr[BATCH], rg[BATCH], rb[BATCH];
+
+        for (int i = 0; i < n; ++i)
+        {
+            nx[i] = in[i].normal.x();
+            ny[i] = in[i].normal.y();
+            nz[i] = in[i].normal.z();
+            px[i] = in[i].view_pos.x();
+            py[i] = in[i].view_pos.y();
+            pz[i] = in[i].view_pos.z();
+            kr[i] = in[i].color.x();
+            kg[i] = in[i].color.y();
+            kb[i] = in[i].color.z();
+            rr[i] = rg[i] = rb[i] = 0;
+        }
+
+        // normalized(): a zero vector is left as it is
+        for (int i = 0; i < n; ++i)
+        {
+            float len2 = dot(nx[i], ny[i], nz[i], nx[i], ny[i], nz[i]);
+            float len = len2 > 0 ? std::sqrt(len2) : 1.0f;
+            nx[i] /= len;
+            ny[i] /= len;
+            nz[i] /= len;
+        }
+
+        for (int k = 0; k < uni.light_count; ++k)
+        {
+            const light& light = uni.lights[k];
+            for (int i = 0; i < n; ++i)
+            {
+                float lx = light.position.x() - px[i], ly = light.position.y() - py[i], lz = light.position.z() - pz[i];
+                float r = dot(lx, ly, lz, lx, ly, lz);
+                float l_len = r > 0 ? std::sqrt(r) : 1.0f;
+                float n_dot_l = std::max(0.0f, dot(nx[i], ny[i], nz[i], lx / l_len, ly / l_len, lz / l_len));
+
+                float hx = (uni.eye_pos.x() - px[i]) + lx;
+                float hy = (uni.eye_pos.y() - py[i]) + ly;
+                float hz = (uni.eye_pos.z() - pz[i]) + lz;
+                float h_len2 = dot(hx, hy, hz, hx, hy, hz);
+                float h_len = h_len2 > 0 ? std::sqrt(h_len2) : 1.0f;
+                float spec = std::pow(std::max(0.0f, dot(nx[i], ny[i], nz[i], hx / h_len, hy / h_len, hz / h_len)), uni.p);
+
+                float ir = light.intensity.x() / r, ig = light.intensity.y() / r, ib = light.intensity.z() / r;
+                rr[i] += (uni.ambient.x() + kr[i] * ir * n_dot_l) + uni.ks.x() * ir * spec;
+                rg[i] += (uni.ambient.y() + kg[i] * ig * n_dot_l) + uni.ks.y() * ig * spec;
+                rb[i] += (uni.ambient.z() + kb[i] * ib * n_dot_l) + uni.ks.z() * ib * spec;
+            }
+        }
+
+        for (int i = 0; i < n; ++i)
+            out[i] = Eigen::Vector3f(rr[i] * 255.f, rg[i] * 255.f, rb[i] * 255.f);
+    }
+};
+
+// Any of the shaders above behind the batched interface, looping over the scalar
+// shader. It has no speed of its own: it is there so the shade_batch paths of
+// draw<Shader> are built and checked against draw_with for every shader.
+template <Eigen::Vector3f (*shader)(const fragment_shader_payload&)>
+struct batched_shader
+{
+    Eigen::Vector3f operator()(const fragment_shader_payload& payload) const { return shader(payload); }
+
+    void shade_batch(const fragment_shader_payload* in, int n, Eigen::Vector3f* out) const
+    {
+        for (int i = 0; i < n; ++i)
+            out[i] = shader(in[i]);
+    }
+};
+
+template <Eigen::Vector3f (*shader)(const fragment_shader_payload&)>
+static void draw_batched_with(rst::rasterizer& r, const MeshView& mesh)
+{
+    static_assert(rst::has_shade_batch<batched_shader<shader>>::value, "batched_shader must be seen as batched");
+    r.draw(mesh, batched_shader<shader>{});
+}
+
+static void draw_phong_batched(rst::rasterizer& r, const MeshView& mesh)
+{
+    static_assert(rst::has_shade_batch<phong_batch_shader>::value, "phong_batch_shader must be seen as batched");
+    r.draw(mesh, phong_batch_shader{});
+}
+
+const std::vector<shader_option> shader_options = {
+    {"texture", texture_fragment_shader, draw_with<texture_fragment_shader>, draw_batched_with<texture_fragment_shader>,
+     "spot_texture.png"},
+    {"normal", normal_fragment_shader, draw_with<normal_fragment_shader>, draw_batched_with<normal_fragment_shader>,
+     "hmap.jpg"},
+    {"phong", phong_fragment_shader, draw_with<phong_fragment_shader>, draw_phong_batched,
+     "hmap.jpg"},
+    {"bump", bump_fragment_shader, draw_with<bump_fragment_shader>, draw_batched_with<bump_fragment_shader>,
+     "hmap.jpg"},
+    {"displacement", displacement_fragment_shader, draw_with<displacement_fragment_shader>, draw_batched_with<displacement_fragment_shader>,
+     "hmap.jpg"},
+};
+
+const shader_option* find_shader(const std::string& name)
+{
+    for (const shader_option& option : shader_options)
+        if (name == option.name)
+            return &option;
+    return nullptr;
+}
+
+cv::Mat frame_image(rst::rasterizer& r, int width, int height)
+{
+    if (r.color_format() == rst::ColorFormat::RGBA8)
+        // already 8 bit BGRA, and the rasterizer draws the next frame into a new buffer
+        return r.color_image();
+
+    // Only the tiles written since the last clear hold anything but black.
+    cv::Mat image = cv::Mat::zeros(height, width, CV_8UC3);
+    for (const rst::screen_rect& tile : r.written_tiles())
+    {
+        for (int y = tile.y0; y < tile.y1; ++y)
+        {
+            // buffers and image both start at the top row
+            int image_y = height - 1 - y;
+            cv::Vec3b* row = image.ptr<cv::Vec3b>(image_y);
+            for (int x = tile.x0; x < tile.x1; ++x)
+            {
+                size_t index = size_t(image_y) * width + x;
+                if (r.color_format() == rst::ColorFormat::RGB32F)
+                {
+                    // RGBA8 packs to B, G, R bytes, rounding like cv::Mat::convertTo
+                    uint32_t c = rst::pack_color(r.frame_data()[index], rst::ColorFormat::RGBA8);
+                    for (int i = 0; i < 3; ++i)
+                        row[x][i] = uint8_t(c >> (8 * i));
+                }
+                else
+                {
+                    uint32_t c = r.packed_data()[index];
+                    for (int i = 0; i < 3; ++i)
+                        row[x][2 - i] = uint8_t((((c >> (10 * i)) & 0x3ff) * 255 + 511) / 1023);
+                }
+            }
+        }
+    }
+    return image;
+}
+
+bool same_frame(const cv::Mat& a, const std::vector<rst::screen_rect>& a_tiles, const cv::Mat& b,
+                const std::vector<rst::screen_rect>& b_tiles)
+{
+    if (a.rows != b.rows || a.cols != b.cols || a.type() != b.type())
+        return false;
+    size_t pixel_size = a.elemSize();
+    for (const auto* tiles : {&a_tiles, &b_tiles})
+    {
+        for (const rst::screen_rect& tile : *tiles)
+        {
+            for (int y = tile.y0; y < tile.y1; ++y)
+            {
+                // same row flip as frame_image
+                int image_y = a.rows - 1 - y;
+                size_t offset = tile.x0 * pixel_size;
+                if (std::memcmp(a.ptr(image_y) + offset, b.ptr(image_y) + offset, (tile.x1 - tile.x0) * pixel_size))
+                    return false;
+            }
+        }
+    }
+    return true;
+}
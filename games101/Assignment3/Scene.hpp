@@ -0,0 +1,56 @@
+//
+// Camera matrices and shaders shared by the Rasterizer and RasterBenchmark programs.
+//
+
+#ifndef RASTERIZER_SCENE_H
+#define RASTERIZER_SCENE_H
+
+#include <eigen3/Eigen/Eigen>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "global.hpp"
+#include "rasterizer.hpp"
+#include "Shader.hpp"
+
+Eigen::Matrix4f get_view_matrix(Eigen::Vector3f eye_pos);
+// Spot's turntable: rotation about y by angle degrees, scaled by 2.5.
+Eigen::Matrix4f get_model_matrix(float angle);
+Eigen::Matrix4f get_projection_matrix(float eye_fov, float aspect_ratio, float zNear, float zFar);
+
+Eigen::Vector3f vertex_shader(const vertex_shader_payload& payload);
+Eigen::Vector3f normal_fragment_shader(const fragment_shader_payload& payload);
+Eigen::Vector3f texture_fragment_shader(const fragment_shader_payload& payload);
+Eigen::Vector3f phong_fragment_shader(const fragment_shader_payload& payload);
+Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload& payload);
+Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload& payload);
+
+// Fragment shaders selectable on the command line, with the texture each one samples.
+// draw renders a mesh with the shader compiled into the raster loop, draw_batched the
+// same through a shade_batch entry point: phong's shades a batch at a time, the others
+// loop over the per-pixel shader. shader is for set_fragment_shader and the
+// std::function path of rst::rasterizer::draw.
+struct shader_option
+{
+    const char* name;
+    Eigen::Vector3f (*shader)(const fragment_shader_payload&);
+    void (*draw)(rst::rasterizer& r, const MeshView& mesh);
+    void (*draw_batched)(rst::rasterizer& r, const MeshView& mesh);
+    const char* texture;
+};
+
+extern const std::vector<shader_option> shader_options;
+
+const shader_option* find_shader(const std::string& name);
+
+// The width x height color buffer of r as an 8 bit BGR (BGRA for RGBA8) image that
+// is left alone once r clears its color buffer for the next frame. RGBA8 hands out
+// the buffer itself, the other formats convert the tiles written since the last clear.
+cv::Mat frame_image(rst::rasterizer& r, int width, int height);
+
+// Whether two frame_image results hold the same pixels. Pixels outside the tiles
+// either frame wrote are black in both, so only those tiles are compared.
+bool same_frame(const cv::Mat& a, const std::vector<rst::screen_rect>& a_tiles, const cv::Mat& b,
+                const std::vector<rst::screen_rect>& b_tiles);
+
+#endif //RASTERIZER_SCENE_H
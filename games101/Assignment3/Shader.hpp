@@ -7,6 +7,32 @@
 #include <eigen3/Eigen/Eigen>
 #include "Texture.hpp"
 
+struct light
+{
+    Eigen::Vector3f position;
+    Eigen::Vector3f intensity;
+};
+
+constexpr int MAX_LIGHTS = 8;
+
+// Constants a draw shares between all its fragments: lights, material and camera.
+// rst::rasterizer keeps one and hands fragment shaders a pointer to it, so they do
+// not rebuild them per pixel. The defaults are Assignment3's scene.
+struct shader_uniforms
+{
+    light lights[MAX_LIGHTS] = {{{20, 20, 20}, {500, 500, 500}}, {{-20, 20, 0}, {500, 500, 500}}};
+    int light_count = 2;
+
+    Eigen::Vector3f ka{0.005, 0.005, 0.005};
+    Eigen::Vector3f ks{0.7937, 0.7937, 0.7937};
+    float p = 150; // specular exponent
+
+    Eigen::Vector3f amb_light_intensity{10, 10, 10};
+    Eigen::Vector3f eye_pos{0, 0, 10};
+
+    // ka * amb_light_intensity, kept up to date by rst::rasterizer::set_uniforms.
+    Eigen::Vector3f ambient = ka.cwiseProduct(amb_light_intensity);
+};
 
 struct fragment_shader_payload
 {
@@ -23,7 +49,12 @@ struct fragment_shader_payload
     Eigen::Vector3f color;
     Eigen::Vector3f normal;
     Eigen::Vector2f tex_coords;
+    // screen space derivatives of tex_coords, for picking a mip level
+    Eigen::Vector2f tex_coords_dx = {0, 0};
+    Eigen::Vector2f tex_coords_dy = {0, 0};
     Texture* texture;
+    // never null for payloads built by rst::rasterizer
+    const shader_uniforms* uniforms = nullptr;
 };
 
 struct vertex_shader_payload
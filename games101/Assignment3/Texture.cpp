@@ -2,3 +2,53 @@
 // Created by LEI XU on 4/27/19.
 //
 
+#include "Texture.hpp"
+
+void Texture::build_mip_chain(const cv::Mat& image)
+{
+    auto allocate = [](int w, int h) {
+        mip_level m;
+        m.width = w;
+        m.height = h;
+        m.tiles_x = (w + TEXTURE_TILE - 1) / TEXTURE_TILE;
+        int tiles_y = (h + TEXTURE_TILE - 1) / TEXTURE_TILE;
+        m.texels.assign(size_t(m.tiles_x) * tiles_y * TEXTURE_TILE * TEXTURE_TILE, 0);
+        return m;
+    };
+
+    levels.clear();
+    levels.push_back(allocate(width, height));
+    for (int y = 0; y < height; ++y)
+    {
+        const cv::Vec3b* row = image.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < width; ++x)
+            levels[0].texels[levels[0].index(x, y)] = row[x][0] | (row[x][1] << 8) | (row[x][2] << 16) | (0xffu << 24);
+    }
+
+    // Each level averages 2x2 texels of the previous one; odd sizes repeat the last
+    // row or column.
+    while (levels.back().width > 1 || levels.back().height > 1)
+    {
+        const mip_level& src = levels.back();
+        mip_level dst = allocate(std::max(src.width / 2, 1), std::max(src.height / 2, 1));
+        for (int y = 0; y < dst.height; ++y)
+        {
+            int y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+            for (int x = 0; x < dst.width; ++x)
+            {
+                int x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+                uint32_t texels[] = {src.at(x0, y0), src.at(x1, y0), src.at(x0, y1), src.at(x1, y1)};
+                uint32_t c = 0;
+                for (int channel = 0; channel < 32; channel += 8)
+                {
+                    uint32_t sum = 2; // round to nearest
+                    for (uint32_t t : texels)
+                        sum += (t >> channel) & 0xff;
+                    c |= (sum / 4) << channel;
+                }
+                dst.texels[dst.index(x, y)] = c;
+            }
+        }
+        levels.push_back(std::move(dst));
+    }
+}
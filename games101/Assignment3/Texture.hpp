@@ -7,35 +7,114 @@
 #include "global.hpp"
 #include <eigen3/Eigen/Eigen>
 #include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Texels are stored as RGBA8 in TEXTURE_TILE x TEXTURE_TILE tiles, Morton ordered
+// inside a tile, so a bilinear footprint almost always stays within one or two
+// cache lines. Every texture carries a full mip chain down to 1x1.
+constexpr int TEXTURE_TILE_BITS = 3;
+constexpr int TEXTURE_TILE = 1 << TEXTURE_TILE_BITS;
+
 class Texture{
 private:
-    cv::Mat image_data;
+    struct mip_level
+    {
+        int width, height;
+        int tiles_x;
+        std::vector<uint32_t> texels;
+
+        // Interleave the low three bits of x and y.
+        static uint32_t morton(uint32_t x, uint32_t y)
+        {
+            auto spread = [](uint32_t v) { return (v & 1) | ((v & 2) << 1) | ((v & 4) << 2); };
+            return spread(x) | (spread(y) << 1);
+        }
+
+        size_t index(int x, int y) const
+        {
+            int tile = (y >> TEXTURE_TILE_BITS) * tiles_x + (x >> TEXTURE_TILE_BITS);
+            return size_t(tile) * TEXTURE_TILE * TEXTURE_TILE + morton(x & (TEXTURE_TILE - 1), y & (TEXTURE_TILE - 1));
+        }
+
+        uint32_t at(int x, int y) const { return texels[index(x, y)]; }
+    };
+
+    std::vector<mip_level> levels;
+
+    static Eigen::Vector3f unpack(uint32_t c)
+    {
+        return Eigen::Vector3f(float(c & 0xff), float((c >> 8) & 0xff), float((c >> 16) & 0xff));
+    }
+
+    void build_mip_chain(const cv::Mat& image);
 
 public:
     Texture(const std::string& name)
     {
-        image_data = cv::imread(name);
+        cv::Mat image_data = cv::imread(name);
         cv::cvtColor(image_data, image_data, cv::COLOR_RGB2BGR);
         width = image_data.cols;
         height = image_data.rows;
+        build_mip_chain(image_data);
     }
 
     int width, height;
 
-    Eigen::Vector3f getColor(float u, float v)
-    {
-        if(u<0)
-            u = 0;
-        if(u>1)
-            u = 1;
-        if(v < 0)
-            v = 0;
-        if(v > 1)
-            v =1;
-        auto u_img = u * width;
-        auto v_img = (1 - v) * height;
-        auto color = image_data.at<cv::Vec3b>(v_img, u_img);
-        return Eigen::Vector3f(color[0], color[1], color[2]);
+    int mip_levels() const { return int(levels.size()); }
+
+    // Nearest texel of the full resolution level.
+    Eigen::Vector3f getColor(float u, float v) const
+    {
+        u = std::clamp(u, 0.0f, 1.0f);
+        v = std::clamp(v, 0.0f, 1.0f);
+        int u_img = std::min(int(u * width), width - 1);
+        int v_img = std::min(int((1 - v) * height), height - 1);
+        return unpack(levels[0].at(u_img, v_img));
+    }
+
+    // Bilinear filtering of one mip level, clamped to the edge.
+    Eigen::Vector3f getColorBilinear(float u, float v, int level = 0) const
+    {
+        const mip_level& m = levels[level];
+        float s = std::clamp(u, 0.0f, 1.0f) * m.width - 0.5f;
+        float t = (1 - std::clamp(v, 0.0f, 1.0f)) * m.height - 0.5f;
+        float sf = std::floor(s), tf = std::floor(t);
+        float fx = s - sf, fy = t - tf;
+
+        int x0 = std::max(int(sf), 0), x1 = std::min(int(sf) + 1, m.width - 1);
+        int y0 = std::max(int(tf), 0), y1 = std::min(int(tf) + 1, m.height - 1);
+
+        Eigen::Vector3f top = unpack(m.at(x0, y0)) * (1 - fx) + unpack(m.at(x1, y0)) * fx;
+        Eigen::Vector3f bottom = unpack(m.at(x0, y1)) * (1 - fx) + unpack(m.at(x1, y1)) * fx;
+        return top * (1 - fy) + bottom * fy;
+    }
+
+    // Mip level to sample for a footprint with the given screen space derivatives of (u, v).
+    float lod(const Eigen::Vector2f& duv_dx, const Eigen::Vector2f& duv_dy) const
+    {
+        Eigen::Vector2f size(width, height);
+        float rho = std::max(duv_dx.cwiseProduct(size).norm(), duv_dy.cwiseProduct(size).norm());
+        return rho > 1 ? std::log2(rho) : 0.0f;
+    }
+
+    // Bilinear samples of the two mip levels around lod, blended.
+    Eigen::Vector3f getColorTrilinear(float u, float v, float lod) const
+    {
+        lod = std::clamp(lod, 0.0f, float(levels.size() - 1));
+        int level = int(lod);
+        float f = lod - level;
+        Eigen::Vector3f c = getColorBilinear(u, v, level);
+        if (f > 0)
+            c = c * (1 - f) + getColorBilinear(u, v, level + 1) * f;
+        return c;
+    }
+
+    Eigen::Vector3f getColorTrilinear(float u, float v, const Eigen::Vector2f& duv_dx, const Eigen::Vector2f& duv_dy) const
+    {
+        return getColorTrilinear(u, v, lod(duv_dx, duv_dy));
     }
 
 };
@@ -0,0 +1,149 @@
+//
+// Compile time switchable tracing for the rasterizer, see Trace.hpp.
+//
+
+#include "Trace.hpp"
+
+#ifdef RST_TRACE
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    constexpr int COUNTERS = int(rst::trace::counter::count);
+    const char* const counter_names[COUNTERS] = {"triangles", "covered_pixels", "depth_passed", "shader_calls"};
+
+    struct zone_event
+    {
+        const char* name;
+        int64_t begin, end; // nanoseconds since trace_epoch
+    };
+
+    struct counter_sample
+    {
+        int64_t time;
+        uint64_t values[COUNTERS];
+    };
+
+    // Everything one thread recorded. Only that thread writes to it.
+    struct thread_log
+    {
+        int tid;
+        std::vector<zone_event> zones;
+        std::vector<size_t> open; // zones not ended yet, innermost last
+        uint64_t counters[COUNTERS] = {};
+        std::vector<counter_sample> samples;
+    };
+
+    const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+    // Logs are never freed, so pool threads that exit still show up in the next file.
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<thread_log>> registry;
+
+    int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_epoch)
+                .count();
+    }
+
+    thread_log& local_log()
+    {
+        thread_local thread_log* log = nullptr;
+        if (!log)
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            registry.push_back(std::make_unique<thread_log>());
+            log = registry.back().get();
+            log->tid = int(registry.size());
+        }
+        return *log;
+    }
+}
+
+void rst::trace::begin_zone(const char* name)
+{
+    thread_log& log = local_log();
+    log.open.push_back(log.zones.size());
+    log.zones.push_back({name, now_ns(), 0});
+}
+
+void rst::trace::end_zone()
+{
+    thread_log& log = local_log();
+    int64_t t = now_ns();
+    log.zones[log.open.back()].end = t;
+    log.open.pop_back();
+
+    // Sample the counters whenever the thread leaves its outermost zone, so each
+    // draw call and each pool job shows what it added.
+    if (log.open.empty())
+    {
+        counter_sample s{t, {}};
+        std::copy(log.counters, log.counters + COUNTERS, s.values);
+        log.samples.push_back(s);
+    }
+}
+
+void rst::trace::add(counter c, uint64_t n)
+{
+    local_log().counters[int(c)] += n;
+}
+
+bool rst::trace::write_chrome_trace(const std::string& path)
+{
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+        return false;
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+    const char* separator = "";
+    auto us = [](int64_t ns) { return double(ns) / 1000.0; };
+    out.precision(3);
+    out << std::fixed;
+    for (const auto& log : registry)
+    {
+        out << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << log->tid
+            << ", \"args\": {\"name\": \"thread " << log->tid << "\"}}";
+        separator = ",\n";
+
+        // Zones still open have not finished yet and are left for the next file.
+        size_t kept = log->open.empty() ? log->zones.size() : log->open.front();
+        for (size_t i = 0; i < kept; ++i)
+        {
+            const zone_event& z = log->zones[i];
+            out << separator << "{\"name\": \"" << z.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << log->tid
+                << ", \"ts\": " << us(z.begin) << ", \"dur\": " << us(z.end - z.begin) << "}";
+        }
+        for (const counter_sample& s : log->samples)
+        {
+            out << separator << "{\"name\": \"counters " << log->tid << "\", \"ph\": \"C\", \"pid\": 1, \"tid\": "
+                << log->tid << ", \"ts\": " << us(s.time) << ", \"args\": {";
+            for (int c = 0; c < COUNTERS; ++c)
+                out << (c ? ", " : "") << "\"" << counter_names[c] << "\": " << s.values[c];
+            out << "}}";
+        }
+
+        log->zones.erase(log->zones.begin(), log->zones.begin() + kept);
+        for (size_t& z : log->open)
+            z -= kept;
+        log->samples.clear();
+    }
+    out << "\n]}\n";
+    return bool(out);
+}
+
+#else
+
+bool rst::trace::write_chrome_trace(const std::string&)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,57 @@
+//
+// Compile time switchable tracing for the rasterizer: scoped zones and per-thread
+// counters, written out as a Chrome trace event file (chrome://tracing or
+// ui.perfetto.dev). Configure with -DRST_TRACE=ON to record; otherwise the macros
+// expand to nothing and their arguments are never evaluated.
+//
+
+#ifndef RASTERIZER_TRACE_H
+#define RASTERIZER_TRACE_H
+
+#include <cstdint>
+#include <string>
+
+namespace rst::trace
+{
+    enum class counter
+    {
+        triangles,      // rasterize_triangle calls
+        covered_pixels, // pixels inside a triangle, before the depth test
+        depth_passed,   // pixels that passed the depth test
+        shader_calls,   // fragment shader invocations
+        count
+    };
+
+#ifdef RST_TRACE
+    void begin_zone(const char* name);
+    void end_zone();
+    void add(counter c, uint64_t n);
+
+    class zone
+    {
+    public:
+        explicit zone(const char* name) { begin_zone(name); }
+        ~zone() { end_zone(); }
+        zone(const zone&) = delete;
+        zone& operator=(const zone&) = delete;
+    };
+#endif
+
+    // Writes everything recorded so far to path and starts over. Must not run while
+    // other threads are recording, i.e. call it between draws. Returns false when the
+    // file cannot be written or tracing is compiled out.
+    bool write_chrome_trace(const std::string& path);
+}
+
+#ifdef RST_TRACE
+#define RST_TRACE_CONCAT_(a, b) a##b
+#define RST_TRACE_CONCAT(a, b) RST_TRACE_CONCAT_(a, b)
+// Times the rest of the enclosing scope under name, which must be a string literal.
+#define RST_TRACE_ZONE(name) ::rst::trace::zone RST_TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#define RST_TRACE_COUNT(c, n) ::rst::trace::add(::rst::trace::counter::c, (n))
+#else
+#define RST_TRACE_ZONE(name) ((void)0)
+#define RST_TRACE_COUNT(c, n) ((void)0)
+#endif
+
+#endif //RASTERIZER_TRACE_H
@@ -1,419 +1,183 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
 #include <iostream>
+#include <map>
+#include <thread>
 #include <opencv2/opencv.hpp>
 
 #include "global.hpp"
 #include "rasterizer.hpp"
 #include "Triangle.hpp"
+#include "Mesh.hpp"
 #include "Shader.hpp"
 #include "Texture.hpp"
-#include "OBJ_Loader.h"
-
-Eigen::Matrix4f get_view_matrix(Eigen::Vector3f eye_pos)
+#include "MeshCache.hpp"
+#include "ImageWriter.hpp"
+#include "Scene.hpp"
+#include "Trace.hpp"
+
+// Renders a turntable of frames evenly spaced angles, starting at angle, for every
+// shader into <prefix><shader>_<frame>.png. The mesh and every texture are loaded
+// once; PNGs are encoded on background threads while the next frame rasterizes.
+int render_batch(rst::rasterizer& r, const MeshView& mesh, const std::string& obj_path,
+                 const std::vector<const shader_option*>& shaders, int frames, const std::string& prefix,
+                 float angle, const Eigen::Vector3f& eye_pos)
 {
-    Eigen::Matrix4f view = Eigen::Matrix4f::Identity();
-
-    Eigen::Matrix4f translate;
-    translate << 1,0,0,-eye_pos[0],
-                 0,1,0,-eye_pos[1],
-                 0,0,1,-eye_pos[2],
-                 0,0,0,1;
+    std::filesystem::path directory = std::filesystem::path(prefix).parent_path();
+    if (!directory.empty())
+        std::filesystem::create_directories(directory);
 
-    view = translate*view;
+    std::map<std::string, Texture> textures;
+    ImageWriter writer(std::max(1u, std::thread::hardware_concurrency() / 4));
 
-    return view;
-}
+    using clock = std::chrono::steady_clock;
+    auto ms_since = [](clock::time_point t) { return std::chrono::duration<double, std::milli>(clock::now() - t).count(); };
+    auto batch_start = clock::now();
+    double render_total = 0, handoff_total = 0;
 
-Eigen::Matrix4f get_model_matrix(float angle)
-{
-    Eigen::Matrix4f rotation;
-    angle = angle * MY_PI / 180.f;
-    rotation << cos(angle), 0, sin(angle), 0,
-                0, 1, 0, 0,
-                -sin(angle), 0, cos(angle), 0,
-                0, 0, 0, 1;
-
-    Eigen::Matrix4f scale;
-    scale << 2.5, 0, 0, 0,
-              0, 2.5, 0, 0,
-              0, 0, 2.5, 0,
-              0, 0, 0, 1;
-
-    Eigen::Matrix4f translate;
-    translate << 1, 0, 0, 0,
-            0, 1, 0, 0,
-            0, 0, 1, 0,
-            0, 0, 0, 1;
-
-    return translate * rotation * scale;
-}
-
-Eigen::Matrix4f get_projection_matrix(float eye_fov, float aspect_ratio, float zNear, float zFar)
-{
-    // TODO: Use the same projection matrix from the previous assignments
-    Eigen::Matrix4f projection = Eigen::Matrix4f::Identity();
-    Eigen::Matrix4f M_trans;
-    Eigen::Matrix4f M_persp;
-    Eigen::Matrix4f M_ortho;
-    
-    float angle = 0.5 * eye_fov * M_PI / 180.0f;
-    // zFar - 
-    M_persp << 
-               zNear, 0, 0, 0,
-               0, zNear, 0, 0,
-               0, 0, zNear + zFar, -zNear*zFar,
-               0, 0, 1, 0;
-               
-    float yTop = -zNear * tan(angle);
-    float yBottom = -yTop;
-    float xRight = yTop * aspect_ratio;
-    float xLeft = - xRight;
-
-    M_trans <<
-        1, 0, 0, -(xLeft + xRight) / 2,
-        0, 1, 0, -(yTop + yBottom) / 2,
-        0, 0, 1, -(zNear + zFar) / 2,
-        0, 0, 0, 1;
-    M_ortho <<
-        2 / (xRight - xLeft), 0, 0, 0,
-        0, 2 / (yTop - yBottom), 0, 0,
-        0, 0, 2 / (zNear - zFar), 0,
-        0, 0, 0, 1;
-
-    M_ortho = M_ortho * M_trans;
-    projection = M_ortho * M_persp * projection;
-
-    return projection;
-}
-
-Eigen::Vector3f vertex_shader(const vertex_shader_payload& payload)
-{
-    return payload.position;
-}
-
-Eigen::Vector3f normal_fragment_shader(const fragment_shader_payload& payload)
-{
-    Eigen::Vector3f return_color = (payload.normal.head<3>().normalized() + Eigen::Vector3f(1.0f, 1.0f, 1.0f)) / 2.f;
-    Eigen::Vector3f result;
-    result << return_color.x() * 255, return_color.y() * 255, return_color.z() * 255;
-    return result;
-}
-
-static Eigen::Vector3f reflect(const Eigen::Vector3f& vec, const Eigen::Vector3f& axis)
-{
-    auto costheta = vec.dot(axis);
-    return (2 * costheta * axis - vec).normalized();
-}
-
-struct light
-{
-    Eigen::Vector3f position;
-    Eigen::Vector3f intensity;
-};
-
-Eigen::Vector3f texture_fragment_shader(const fragment_shader_payload& payload)
-{
-    Eigen::Vector3f return_color = {0, 0, 0};
-    if (payload.texture)
+    r.set_view(get_view_matrix(eye_pos));
+    r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
+    for (const shader_option* option : shaders)
     {
-        // TODO: Get the texture value at the texture coordinates of the current fragment
-        return_color = payload.texture -> getColor(payload.tex_coords.x(), payload.tex_coords.y());
-    }
-    Eigen::Vector3f texture_color;
-    texture_color << return_color.x(), return_color.y(), return_color.z();
-
-    Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
-    Eigen::Vector3f kd = texture_color / 255.f;
-    Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
-
-    auto l1 = light{{20, 20, 20}, {500, 500, 500}};
-    auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
-
-    std::vector<light> lights = {l1, l2};
-    Eigen::Vector3f amb_light_intensity{10, 10, 10};
-    Eigen::Vector3f eye_pos{0, 0, 10};
+        auto texture = textures.find(option->texture);
+        if (texture == textures.end())
+            texture = textures.emplace(option->texture, Texture(obj_path + option->texture)).first;
+        r.set_texture(texture->second);
 
-    float p = 150;
-
-    Eigen::Vector3f color = texture_color;
-    Eigen::Vector3f point = payload.view_pos;
-    Eigen::Vector3f normal = payload.normal;
-
-    Eigen::Vector3f result_color = {0, 0, 0};
-
-    for (auto& light : lights)
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            float frame_angle = angle + 360.0f * frame / frames;
+
+            auto start = clock::now();
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+            r.set_model(get_model_matrix(frame_angle));
+            option->draw(r, mesh);
+            double render_ms = ms_since(start);
+
+            // Conversion happens here, the PNG encode on the writer's threads; this only
+            // waits when the encoders have fallen behind.
+            start = clock::now();
+            char name[32];
+            std::snprintf(name, sizeof(name), "_%04d.png", frame);
+            writer.write(prefix + option->name + name, frame_image(r, 700, 700));
+            double handoff_ms = ms_since(start);
+
+            render_total += render_ms;
+            handoff_total += handoff_ms;
+            std::printf("%s frame %d/%d (%.1f deg): render %.2f ms, hand off %.2f ms\n", option->name, frame + 1,
+                        frames, frame_angle, render_ms, handoff_ms);
+        }
+    }
+    writer.wait();
+
+    int total = frames * int(shaders.size());
+    double wall = ms_since(batch_start);
+    std::printf("%d frames in %.1f ms (%.2f ms/frame): render %.2f ms/frame, hand off %.2f ms/frame, "
+                "encode %.2f ms/frame in the background\n",
+                total, wall, wall / total, render_total / total, handoff_total / total, writer.encode_ms() / total);
+    if (writer.failures() > 0)
     {
-        // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
-        // components are. Then, accumulate that result on the *result_color* object.
-        auto v = eye_pos - point; //v为出射光方向（指向眼睛）
-        auto l = light.position - point; //l为指向入射光源方向
-        auto h = (v + l).normalized(); //h为半程向量即v+l归一化后的单位向量
-        auto r = l.dot(l); //衰减因子
-        auto ambient = ka.cwiseProduct(amb_light_intensity);
-        auto diffuse = kd.cwiseProduct(light.intensity / r) * std::max(0.0f, normal.normalized().dot(l.normalized()));
-        auto specular = ks.cwiseProduct(light.intensity / r) * std::pow(std::max(0.0f, normal.normalized().dot(h)), p);
-        result_color += (ambient + diffuse + specular);
+        std::cerr << writer.failures() << " images could not be written\n";
+        return 1;
     }
-
-    return result_color * 255.f;
+    return 0;
 }
 
-Eigen::Vector3f phong_fragment_shader(const fragment_shader_payload& payload)
+int main(int argc, const char** argv)
 {
-    Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
-    Eigen::Vector3f kd = payload.color;
-    Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
-
-    auto l1 = light{{20, 20, 20}, {500, 500, 500}};
-    auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
+    MappedMesh mesh;
 
-    std::vector<light> lights = {l1, l2};
-    Eigen::Vector3f amb_light_intensity{10, 10, 10};
-    Eigen::Vector3f eye_pos{0, 0, 10};
-
-    float p = 150;
+    float angle = 140.0;
+    bool command_line = false;
+    bool batch = argc >= 2 && std::string(argv[1]) == "batch";
 
-    Eigen::Vector3f color = payload.color;
-    Eigen::Vector3f point = payload.view_pos;
-    Eigen::Vector3f normal = payload.normal;
+    std::string filename = "output.png";
+    std::string obj_path = "../models/spot/";
 
-    Eigen::Vector3f result_color = {0, 0, 0};
-    for (auto& light : lights)
+    if (batch && argc < 4)
     {
-        // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
-        // components are. Then, accumulate that result on the *result_color* object.
-        auto ambient = ka.cwiseProduct(amb_light_intensity); //环境光
-
-        auto l = light.position - point; //l为指向入射光源方向
-        auto r = l.dot(l); //衰减因子
-
-        auto diffuse = kd.cwiseProduct(light.intensity / r) * std::max(0.0f, normal.normalized().dot(l.normalized()));
-
-        auto v = eye_pos - point;
-        auto h = (v + l).normalized(); //h为半程向量即v+l归一化后的单位向量
-
-        auto specular = ks.cwiseProduct(light.intensity / r) * std::pow(std::max(0.0f, normal.normalized().dot(h)),p);
-
-        result_color += (ambient + diffuse + specular);
+        std::cerr << "usage: " << argv[0] << " batch <frames> <output prefix> [shader...] [deferred]\n";
+        return 1;
     }
 
-    return result_color * 255.f;
-}
-
-
-
-Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload& payload)
-{
-    
-    Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
-    Eigen::Vector3f kd = payload.color;
-    Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
-
-    auto l1 = light{{20, 20, 20}, {500, 500, 500}};
-    auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
-
-    std::vector<light> lights = {l1, l2};
-    Eigen::Vector3f amb_light_intensity{10, 10, 10};
-    Eigen::Vector3f eye_pos{0, 0, 10};
-
-    float p = 150;
-
-    Eigen::Vector3f color = payload.color; 
-    Eigen::Vector3f point = payload.view_pos;
-    Eigen::Vector3f normal = payload.normal;
-
-    float kh = 0.2, kn = 0.1;
-    
-    // TODO: Implement displacement mapping here
-    // Let n = normal = (x, y, z)
-    // Vector t = (x*y/sqrt(x*x+z*z),sqrt(x*x+z*z),z*y/sqrt(x*x+z*z))
-    // Vector b = n cross product t
-    // Matrix TBN = [t b n]
-    // dU = kh * kn * (h(u+1/w,v)-h(u,v))
-    // dV = kh * kn * (h(u,v+1/h)-h(u,v))
-    // Vector ln = (-dU, -dV, 1)
-    // Position p = p + kn * n * h(u,v)
-    // Normal n = normalize(TBN * ln)
-
-    auto x = normal.x();
-    auto y = normal.y();
-    auto z = normal.z();
-    Eigen::Vector3f t(x * y / sqrt(x * x + z * z), sqrt(x * x + z * z), z * y / sqrt(x * x + z * z));
-    Eigen::Vector3f b = normal.cross(t);
-    Eigen::Matrix3f TBN; //TBN矩阵: 将纹理坐标对应到模型空间中
-    TBN <<
-        t.x(), b.x(), normal.x(),
-        t.y(), b.y(), normal.y(),
-        t.z(), b.z(), normal.z();
-
-    auto u = payload.tex_coords.x();
-    auto v = payload.tex_coords.y();
-    auto w = payload.texture->width;
-    auto h = payload.texture->height;
-
-    auto dU = kh * kn * (payload.texture->getColor(u + 1.0f / w, v).norm() - payload.texture->getColor(u, v).norm());
-    auto dV = kh * kn * (payload.texture->getColor(u, v + 1.0f / h).norm() - payload.texture->getColor(u, v).norm());
-
-    Eigen::Vector3f ln{ -dU,-dV,1.0f };
-    point += (kn * normal * payload.texture->getColor(u, v).norm()); //
-    normal = TBN * ln;
-    normal.normalized();
-
-    Eigen::Vector3f result_color = {0, 0, 0};
-
-    for (auto& light : lights)
+    // Load .obj File
+    ThreadPool loader_pool(std::thread::hardware_concurrency());
+    std::string error;
+    // Parsed once into spot.rstmesh in the working directory, mapped directly afterwards.
+    if (!load_mesh_cached("../models/spot/spot_triangulated_good.obj", "spot.rstmesh", mesh, &loader_pool, &error,
+                          true))
     {
-        // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
-        // components are. Then, accumulate that result on the *result_color* object.
-        auto v = eye_pos - point; //v为出射光方向（指向眼睛）
-        auto l = light.position - point; //l为指向入射光源方向
-        auto h = (v + l).normalized(); //h为半程向量即v+l归一化后的单位向量
-        auto r = l.dot(l); //衰减因子
-        auto ambient = ka.cwiseProduct(amb_light_intensity);
-        auto diffuse = kd.cwiseProduct(light.intensity / r) * std::max(0.0f, normal.normalized().dot(l.normalized()));
-        auto specular = ks.cwiseProduct(light.intensity / r) * std::pow(std::max(0.0f, normal.normalized().dot(h)), p);
-        result_color += (ambient + diffuse + specular);
+        std::cerr << error << '\n';
+        return 1;
     }
+    if (!error.empty())
+        std::cerr << error << '\n';
 
-    return result_color * 255.f;
-}
-
-
-Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload& payload)
-{
-    
-    Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
-    Eigen::Vector3f kd = payload.color;
-    Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
-
-    auto l1 = light{{20, 20, 20}, {500, 500, 500}};
-    auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
-
-    std::vector<light> lights = {l1, l2};
-    Eigen::Vector3f amb_light_intensity{10, 10, 10};
-    Eigen::Vector3f eye_pos{0, 0, 10};
-
-    float p = 150;
-
-    Eigen::Vector3f color = payload.color; 
-    Eigen::Vector3f point = payload.view_pos;
-    Eigen::Vector3f normal = payload.normal;
-
-
-    float kh = 0.2, kn = 0.1;
-
-    // TODO: Implement bump mapping here
-    // Let n = normal = (x, y, z)
-    // Vector t = (x*y/sqrt(x*x+z*z),sqrt(x*x+z*z),z*y/sqrt(x*x+z*z))
-    // Vector b = n cross product t
-    // Matrix TBN = [t b n]
-    // dU = kh * kn * (h(u+1/w,v)-h(u,v))
-    // dV = kh * kn * (h(u,v+1/h)-h(u,v))
-    // Vector ln = (-dU, -dV, 1)
-    // Normal n = normalize(TBN * ln)
-    auto x = normal.x();
-    auto y = normal.y();
-    auto z = normal.z();
-
-    Eigen::Vector3f t(x * y / sqrt(x * x + z * z), sqrt(x*x+z*z),z*y/sqrt(x*x+z*z));
-    Eigen::Vector3f b = normal.cross(t);
-    Eigen::Matrix3f TBN;
-    TBN << 
-        t.x(), b.x(), normal.x(),
-        t.y(), b.y(), normal.y(),
-        t.z(), b.z(), normal.z();
-
-    auto u = payload.tex_coords.x();
-    auto v = payload.tex_coords.y();
-    auto w = payload.texture->width;
-    auto h = payload.texture->height;
-
-    auto dU = kh * kn * (payload.texture->getColor(u + 1.0f / w, v).norm() - payload.texture->getColor(u, v).norm());
-    auto dV = kh * kn * (payload.texture->getColor(u, v + 1.0f / h).norm() - payload.texture->getColor(u, v).norm());
-
-    Eigen::Vector3f ln{ -dU,-dV,1.0f };
-    normal = TBN * ln;
-    Eigen::Vector3f result_color = normal.normalized();
-
-    // Eigen::Vector3f result_color = {0, 0, 0};
-    // result_color = normal;
-
-    return result_color * 255.f;
-}
-
-int main(int argc, const char** argv)
-{
-    std::vector<Triangle*> TriangleList;
-
-    float angle = 140.0;
-    bool command_line = false;
+    rst::rasterizer r(700, 700);
+    Eigen::Vector3f eye_pos = {0,0,10};
 
-    std::string filename = "output.png";
-    objl::Loader Loader;
-    std::string obj_path = "../models/spot/";
+    r.set_vertex_shader(vertex_shader);
+    r.set_threads(std::thread::hardware_concurrency());
+    r.set_cull_mode(rst::CullMode::Back);
+    // Shaded pixels are packed straight into the 8 bit BGRA image that gets written out.
+    r.set_color_format(rst::ColorFormat::RGBA8);
+    bool deferred = !batch && argc >= 4 && std::string(argv[3]) == "deferred";
+    for (int i = 4; batch && i < argc; ++i)
+        deferred = deferred || std::string(argv[i]) == "deferred";
+    if (deferred)
+    {
+        std::cout << "Deferred shading\n";
+        r.set_deferred(true);
+    }
 
-    // Load .obj File
-    bool loadout = Loader.LoadFile("../models/spot/spot_triangulated_good.obj");
-    for(auto mesh:Loader.LoadedMeshes)
+    if (batch)
     {
-        for(int i=0;i<mesh.Vertices.size();i+=3)
+        int frames = std::atoi(argv[2]);
+        std::vector<const shader_option*> shaders;
+        for (int i = 4; i < argc; ++i)
         {
-            Triangle* t = new Triangle();
-            for(int j=0;j<3;j++)
+            if (std::string(argv[i]) == "deferred")
+                continue;
+            const shader_option* option = find_shader(argv[i]);
+            if (!option)
             {
-                t->setVertex(j,Vector4f(mesh.Vertices[i+j].Position.X,mesh.Vertices[i+j].Position.Y,mesh.Vertices[i+j].Position.Z,1.0));
-                t->setNormal(j,Vector3f(mesh.Vertices[i+j].Normal.X,mesh.Vertices[i+j].Normal.Y,mesh.Vertices[i+j].Normal.Z));
-                t->setTexCoord(j,Vector2f(mesh.Vertices[i+j].TextureCoordinate.X, mesh.Vertices[i+j].TextureCoordinate.Y));
+                std::cerr << "unknown shader " << argv[i] << '\n';
+                return 1;
             }
-            TriangleList.push_back(t);
+            shaders.push_back(option);
+        }
+        if (shaders.empty())
+            shaders.push_back(find_shader("texture"));
+        if (frames <= 0)
+        {
+            std::cerr << "frame count must be positive\n";
+            return 1;
         }
+        return render_batch(r, mesh.view(), obj_path, shaders, frames, argv[3], angle, eye_pos);
     }
 
-    rst::rasterizer r(700, 700);
-
     auto texture_path = "hmap.jpg";
     // auto texture_path = "spot_texture.png";
     r.set_texture(Texture(obj_path + texture_path));
 
-    std::function<Eigen::Vector3f(fragment_shader_payload)> active_shader = texture_fragment_shader;
+    const shader_option* active_shader = find_shader("texture");
 
     if (argc >= 2)
     {
         command_line = true;
         filename = std::string(argv[1]);
 
-        if (argc == 3 && std::string(argv[2]) == "texture")
-        {
-            std::cout << "Rasterizing using the texture shader\n";
-            active_shader = texture_fragment_shader;
-            texture_path = "spot_texture.png";
-            r.set_texture(Texture(obj_path + texture_path));
-        }
-        else if (argc == 3 && std::string(argv[2]) == "normal")
-        {
-            std::cout << "Rasterizing using the normal shader\n";
-            active_shader = normal_fragment_shader;
-        }
-        else if (argc == 3 && std::string(argv[2]) == "phong")
-        {
-            std::cout << "Rasterizing using the phong shader\n";
-            active_shader = phong_fragment_shader;
-        }
-        else if (argc == 3 && std::string(argv[2]) == "bump")
-        {
-            std::cout << "Rasterizing using the bump shader\n";
-            active_shader = bump_fragment_shader;
-        }
-        else if (argc == 3 && std::string(argv[2]) == "displacement")
+        if (const shader_option* option = argc >= 3 ? find_shader(argv[2]) : nullptr)
         {
-            std::cout << "Rasterizing using the bump shader\n";
-            active_shader = displacement_fragment_shader;
+            std::cout << "Rasterizing using the " << option->name << " shader\n";
+            active_shader = option;
+            if (option->texture != std::string(texture_path))
+                r.set_texture(Texture(obj_path + option->texture));
         }
     }
 
-    Eigen::Vector3f eye_pos = {0,0,10};
-
-    r.set_vertex_shader(vertex_shader);
-    r.set_fragment_shader(active_shader);
+    r.set_fragment_shader(active_shader->shader);
 
     int key = 0;
     int frame_count = 0;
@@ -425,33 +189,76 @@ int main(int argc, const char** argv)
         r.set_view(get_view_matrix(eye_pos));
         r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
 
-        r.draw(TriangleList);
-        cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
-        image.convertTo(image, CV_8UC3, 1.0f);
-        cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+        active_shader->draw(r, mesh.view());
+        cv::imwrite(filename, frame_image(r, 700, 700));
 
-        cv::imwrite(filename, image);
+        auto& stats = r.stats();
+        std::cout << "Frustum culled triangles: " << stats.frustum_culled
+                  << ", outside clip planes: " << stats.clip_rejected
+                  << ", face culled: " << stats.face_culled
+                  << ", clipped: " << stats.clipped << '\n';
+        std::cout << "Hi-Z rejected triangles: " << stats.occluded_triangles
+                  << ", rejected tiles: " << stats.occluded_tiles
+                  << ", depth test passes: " << stats.depth_passed
+                  << ", shader invocations: " << stats.shaded_pixels << '\n';
+
+        // Only built with RST_TRACE
+        if (rst::trace::write_chrome_trace("trace.json"))
+            std::cout << "Trace written to trace.json\n";
 
         return 0;
     }
 
+    // Everything a frame is drawn from. The loop only renders when one of these
+    // changes, so an idle window costs nothing.
+    struct frame_inputs
+    {
+        Eigen::Matrix4f model, view, projection;
+        const shader_option* shader;
+
+        bool operator==(const frame_inputs& other) const
+        {
+            return model == other.model && view == other.view && projection == other.projection &&
+                   shader == other.shader;
+        }
+    };
+    frame_inputs drawn{};
+    bool have_frame = false;
+    cv::Mat shown;
+    std::vector<rst::screen_rect> shown_tiles;
+
     while(key != 27)
     {
-        r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+        frame_inputs inputs{get_model_matrix(angle), get_view_matrix(eye_pos),
+                            get_projection_matrix(45.0, 1, 0.1, 50), active_shader};
+        if (!have_frame || !(inputs == drawn))
+        {
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
 
-        r.set_model(get_model_matrix(angle));
-        r.set_view(get_view_matrix(eye_pos));
-        r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
+            r.set_model(inputs.model);
+            r.set_view(inputs.view);
+            r.set_projection(inputs.projection);
+
+            //r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
+            active_shader->draw(r, mesh.view());
+            // The clear and the conversion only touch the tiles the mesh covers, and
+            // the comparison only the tiles either frame covers.
+            cv::Mat image = frame_image(r, 700, 700);
+            std::vector<rst::screen_rect> tiles = r.written_tiles();
 
-        //r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
-        r.draw(TriangleList);
-        cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
-        image.convertTo(image, CV_8UC3, 1.0f);
-        cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+            if (!have_frame || !same_frame(shown, shown_tiles, image, tiles))
+            {
+                cv::imshow("image", image);
+                cv::imwrite(filename, image);
+                shown = image;
+                shown_tiles = std::move(tiles);
+            }
+            drawn = inputs;
+            have_frame = true;
+        }
 
-        cv::imshow("image", image);
-        cv::imwrite(filename, image);
-        key = cv::waitKey(10);
+        // Only a key can change the inputs, so block on the window instead of polling.
+        key = cv::waitKey(0);
 
         if (key == 'a' )
         {
@@ -0,0 +1,68 @@
+//
+// Load time benchmark for the .obj parser: every .obj file under a directory
+// (../models by default), parsed serially and on a thread pool.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ObjParser.hpp"
+#include "OBJ_Loader.h"
+
+// Best of runs, in milliseconds.
+template <typename F>
+static double time_ms(int runs, F&& f)
+{
+    double best = 1e30;
+    for (int i = 0; i < runs; ++i)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    return best;
+}
+
+int main(int argc, const char** argv)
+{
+    std::string dir = argc >= 2 ? argv[1] : "../models";
+    int runs = argc >= 3 ? std::max(1, std::atoi(argv[2])) : 5;
+
+    std::vector<std::filesystem::path> files;
+    for (auto& entry : std::filesystem::recursive_directory_iterator(dir))
+        if (entry.is_regular_file() && entry.path().extension() == ".obj")
+            files.push_back(entry.path());
+    std::sort(files.begin(), files.end());
+
+    ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    std::printf("%d threads, best of %d runs\n", pool.size(), runs);
+    std::printf("%-48s %10s %10s %10s %10s %10s %10s\n", "file", "KiB", "faces", "serial ms", "pool ms", "MiB/s", "objl ms");
+
+    for (auto& path : files)
+    {
+        std::string name = path.string();
+        double kib = std::filesystem::file_size(path) / 1024.0;
+
+        ObjData data;
+        std::string error;
+        if (!parse_obj(name, data, nullptr, &error))
+        {
+            std::printf("%-48s %s\n", name.c_str(), error.c_str());
+            continue;
+        }
+
+        double serial = time_ms(runs, [&] { ObjData d; parse_obj(name, d); });
+        double parallel = time_ms(runs, [&] { ObjData d; parse_obj(name, d, &pool); });
+        double objl = time_ms(runs, [&] { objl::Loader loader; loader.LoadFile(name, &pool); });
+
+        std::printf("%-48s %10.1f %10zu %10.3f %10.3f %10.1f %10.3f\n", name.c_str(), kib, data.face_count(),
+                    serial, parallel, kib / 1024.0 / (parallel / 1000.0), objl);
+    }
+    return 0;
+}
@@ -0,0 +1,244 @@
+//
+// Rendering benchmark for rst::rasterizer: fixed scenes at several resolutions with
+// every fragment shader, forward and deferred. Prints the median and p99 time of each
+// pipeline stage and the pixel throughput as JSON, for tracking regressions. Forward
+// mode shades inside the raster stage, deferred mode reports shading on its own.
+//
+// ./RasterBenchmark [--frames N] [--threads N] [--models dir] [--scene name] [--shader name] [--dynamic]
+//     [--batched] [--color rgb32f|rgba8|rgb10a2] [--depth d32f|d24|d16] > result.json
+//
+// --dynamic shades through set_fragment_shader's std::function instead of draw<Shader>,
+// --batched through draw<Shader> with the shader's shade_batch entry point (a batch
+// implementation for phong, a loop over the per-pixel shader for the rest).
+// --color and --depth pick the frame buffer formats, RGB32F and D32F by default.
+// clear is the time r.clear takes to mark the written tiles stale.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rasterizer.hpp"
+#include "Mesh.hpp"
+#include "Texture.hpp"
+#include "ObjParser.hpp"
+#include "Scene.hpp"
+
+struct bench_scene
+{
+    std::string name;
+    Mesh mesh;
+    Eigen::Matrix4f model;
+    Eigen::Vector3f eye_pos;
+};
+
+// A flat triangle list facing +z, texture coordinates taken from x and y.
+static Mesh flat_mesh(const std::vector<Eigen::Vector3f>& positions)
+{
+    Mesh mesh;
+    for (const Eigen::Vector3f& p : positions)
+        mesh.add_vertex(p, Eigen::Vector3f(0, 0, 1), Eigen::Vector2f((p.x() + 4) / 8, (p.y() + 4) / 8));
+    for (uint32_t i = 0; i + 2 < positions.size(); i += 3)
+        mesh.add_triangle(i, i + 1, i + 2);
+    return mesh;
+}
+
+// Centres a model on the origin, scales it to a radius of 2 and turns it the way
+// Assignment3 shows spot.
+static Eigen::Matrix4f framing(const Eigen::AlignedBox3f& bounds)
+{
+    float radius = std::max(bounds.sizes().norm() / 2, 1e-6f);
+    Eigen::Affine3f t = Eigen::Affine3f::Identity();
+    t.rotate(Eigen::AngleAxisf(140.0f * float(MY_PI) / 180.0f, Eigen::Vector3f::UnitY()));
+    t.scale(2.0f / radius);
+    t.translate(-bounds.center());
+    return t.matrix();
+}
+
+static double percentile(std::vector<double> samples, double p)
+{
+    std::sort(samples.begin(), samples.end());
+    size_t rank = size_t(std::ceil(p * samples.size()));
+    return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+int main(int argc, const char** argv)
+{
+    int frames = 20;
+    int threads = int(std::max(1u, std::thread::hardware_concurrency()));
+    std::string models = "../models";
+    std::string only_scene, only_shader;
+    std::string shading = "inline";
+    rst::ColorFormat color_format = rst::ColorFormat::RGB32F;
+    rst::DepthFormat depth_format = rst::DepthFormat::D32F;
+    const std::map<std::string, rst::ColorFormat> color_formats = {
+        {"rgb32f", rst::ColorFormat::RGB32F}, {"rgba8", rst::ColorFormat::RGBA8}, {"rgb10a2", rst::ColorFormat::RGB10A2}};
+    const std::map<std::string, rst::DepthFormat> depth_formats = {
+        {"d32f", rst::DepthFormat::D32F}, {"d24", rst::DepthFormat::D24}, {"d16", rst::DepthFormat::D16}};
+    std::string color_name = "rgb32f", depth_name = "d32f";
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string flag = argv[i];
+        bool has_value = i + 1 < argc;
+        if (flag == "--dynamic")
+            shading = "dynamic";
+        else if (flag == "--batched")
+            shading = "batched";
+        else if (flag == "--frames" && has_value)
+            frames = std::max(1, std::atoi(argv[++i]));
+        else if (flag == "--threads" && has_value)
+            threads = std::max(1, std::atoi(argv[++i]));
+        else if (flag == "--models" && has_value)
+            models = argv[++i];
+        else if (flag == "--scene" && has_value)
+            only_scene = argv[++i];
+        else if (flag == "--shader" && has_value)
+            only_shader = argv[++i];
+        else if (flag == "--color" && has_value && color_formats.count(argv[i + 1]))
+            color_format = color_formats.at(color_name = argv[++i]);
+        else if (flag == "--depth" && has_value && depth_formats.count(argv[i + 1]))
+            depth_format = depth_formats.at(depth_name = argv[++i]);
+        else
+        {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // The single triangle of Assignment1 and the two overlapping ones of Assignment2,
+    // seen from where those assignments put the camera.
+    std::vector<bench_scene> scenes;
+    scenes.push_back({"triangle", flat_mesh({{2, 0, -2}, {0, 2, -2}, {-2, 0, -2}}),
+                      Eigen::Matrix4f::Identity(), {0, 0, 5}});
+    scenes.push_back({"two_triangles",
+                      flat_mesh({{2, 0, -2}, {0, 2, -2}, {-2, 0, -2}, {3.5, -1, -5}, {2.5, 1.5, -5}, {-1, 0.5, -5}}),
+                      Eigen::Matrix4f::Identity(), {0, 0, 5}});
+
+    const std::pair<const char*, const char*> model_files[] = {
+        {"spot", "/spot/spot_triangulated_good.obj"},
+        {"bunny", "/bunny/bunny.obj"},
+        {"crate", "/Crate/Crate1.obj"},
+        {"rock", "/rock/rock.obj"},
+    };
+    for (const auto& file : model_files)
+    {
+        if (!only_scene.empty() && only_scene != file.first)
+            continue;
+        bench_scene s{file.first, Mesh(), Eigen::Matrix4f::Identity(), {0, 0, 10}};
+        std::string error;
+        if (!load_obj(models + file.second, s.mesh, nullptr, &error, true))
+        {
+            std::fprintf(stderr, "skipping %s: %s\n", file.first, error.c_str());
+            continue;
+        }
+        s.model = framing(s.mesh.bounds);
+        scenes.push_back(std::move(s));
+    }
+
+    const int resolutions[] = {256, 700, 1024};
+    std::map<std::string, Texture> textures;
+
+    std::printf("{\n  \"threads\": %d,\n  \"frames\": %d,\n  \"shading\": \"%s\",\n  \"color_format\": \"%s\",\n"
+                "  \"depth_format\": \"%s\",\n  \"results\": [", threads, frames, shading.c_str(),
+                color_name.c_str(), depth_name.c_str());
+    const char* separator = "\n";
+    for (const bench_scene& s : scenes)
+    {
+        if (!only_scene.empty() && only_scene != s.name)
+            continue;
+        for (int size : resolutions)
+        {
+            for (bool deferred : {false, true})
+            {
+                rst::rasterizer r(size, size);
+                r.set_vertex_shader(vertex_shader);
+                r.set_threads(threads);
+                r.set_cull_mode(rst::CullMode::Back);
+                r.set_deferred(deferred);
+                r.set_stage_timing(true);
+                r.set_color_format(color_format);
+                r.set_depth_format(depth_format);
+                r.set_model(s.model);
+                r.set_view(get_view_matrix(s.eye_pos));
+                r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
+
+                for (const shader_option& option : shader_options)
+                {
+                    if (!only_shader.empty() && only_shader != option.name)
+                        continue;
+                    auto texture = textures.find(option.texture);
+                    if (texture == textures.end())
+                        texture = textures.emplace(option.texture, Texture(models + "/spot/" + option.texture)).first;
+                    r.set_texture(texture->second);
+                    r.set_fragment_shader(option.shader);
+
+                    std::fprintf(stderr, "%s %dx%d %s %s\n", s.name.c_str(), size, size, option.name,
+                                 deferred ? "deferred" : "forward");
+
+                    // Two warm up frames fill the caches and size every buffer.
+                    std::vector<double> clear, vertex, clip, raster, shade, resolve, total;
+                    uint64_t shaded = 0;
+                    for (int frame = -2; frame < frames; ++frame)
+                    {
+                        auto clear_start = std::chrono::steady_clock::now();
+                        r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+                        double clear_ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - clear_start).count();
+                        r.reset_stats();
+                        if (shading == "dynamic")
+                            r.draw(s.mesh.view());
+                        else if (shading == "batched")
+                            option.draw_batched(r, s.mesh.view());
+                        else
+                            option.draw(r, s.mesh.view());
+
+                        // Resolve: turning the frame buffer into the 8 bit image every
+                        // caller writes out.
+                        auto start = std::chrono::steady_clock::now();
+                        cv::Mat image = frame_image(r, size, size);
+                        double resolve_ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start).count();
+
+                        if (frame < 0)
+                            continue;
+                        const rst::stage_timings& t = r.timings();
+                        clear.push_back(clear_ms);
+                        vertex.push_back(t.vertex);
+                        clip.push_back(t.clip);
+                        raster.push_back(t.raster);
+                        shade.push_back(t.shade);
+                        resolve.push_back(resolve_ms);
+                        total.push_back(clear_ms + t.vertex + t.clip + t.raster + t.shade + resolve_ms);
+                        shaded = r.stats().shaded_pixels;
+                    }
+
+                    double median_total = percentile(total, 0.5);
+                    std::printf("%s    {\"scene\": \"%s\", \"width\": %d, \"height\": %d, \"shader\": \"%s\", "
+                                "\"mode\": \"%s\", \"triangles\": %zu, \"shaded_pixels\": %llu,\n",
+                                separator, s.name.c_str(), size, size, option.name,
+                                deferred ? "deferred" : "forward", s.mesh.view().triangle_count(),
+                                (unsigned long long)shaded);
+                    std::printf("     \"stages_ms\": {");
+                    const std::pair<const char*, const std::vector<double>*> stages[] = {
+                        {"clear", &clear}, {"vertex", &vertex}, {"clip", &clip}, {"raster", &raster}, {"shade", &shade},
+                        {"resolve", &resolve}, {"total", &total}};
+                    for (size_t i = 0; i < std::size(stages); ++i)
+                        std::printf("%s\"%s\": {\"median\": %.4f, \"p99\": %.4f}", i ? ", " : "", stages[i].first,
+                                    percentile(*stages[i].second, 0.5), percentile(*stages[i].second, 0.99));
+                    std::printf("},\n     \"pixels_per_second\": %.0f, \"shaded_pixels_per_second\": %.0f}",
+                                double(size) * size / (median_total / 1000), shaded / (median_total / 1000));
+                    separator = ",\n";
+                }
+            }
+        }
+    }
+    std::printf("\n  ]\n}\n");
+    return 0;
+}
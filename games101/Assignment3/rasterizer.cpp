@@ -3,7 +3,11 @@
 //
 
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
 #include "rasterizer.hpp"
+#include "Trace.hpp"
 #include <opencv2/opencv.hpp>
 #include <math.h>
 
@@ -149,116 +153,600 @@ auto to_vec4(const Eigen::Vector3f& v3, float w = 1.0f)
     return Vector4f(v3.x(), v3.y(), v3.z(), w);
 }
 
-static bool insideTriangle(int x, int y, const Vector4f* _v){
-    Vector3f v[3];
-    for(int i=0;i<3;i++)
-        v[i] = {_v[i].x(),_v[i].y(), 1.0};
-    Vector3f f0,f1,f2;
-    f0 = v[1].cross(v[0]);
-    f1 = v[2].cross(v[1]);
-    f2 = v[0].cross(v[2]);
-    Vector3f p(x,y,1.);
-    if((p.dot(f0)*f0.dot(v[2])>0) && (p.dot(f1)*f1.dot(v[0])>0) && (p.dot(f2)*f2.dot(v[1])>0))
-        return true;
-    return false;
+static rst::clip_vertex lerp(const rst::clip_vertex& a, const rst::clip_vertex& b, float t)
+{
+    return {a.clip + t * (b.clip - a.clip),
+            a.view_pos + t * (b.view_pos - a.view_pos),
+            a.normal + t * (b.normal - a.normal),
+            a.tex_coords + t * (b.tex_coords - a.tex_coords)};
 }
 
-static std::tuple<float, float, float> computeBarycentric2D(float x, float y, const Vector4f* v){
-    float c1 = (x*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*y + v[1].x()*v[2].y() - v[2].x()*v[1].y()) / (v[0].x()*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*v[0].y() + v[1].x()*v[2].y() - v[2].x()*v[1].y());
-    float c2 = (x*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*y + v[2].x()*v[0].y() - v[0].x()*v[2].y()) / (v[1].x()*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*v[1].y() + v[2].x()*v[0].y() - v[0].x()*v[2].y());
-    float c3 = (x*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*y + v[0].x()*v[1].y() - v[1].x()*v[0].y()) / (v[2].x()*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*v[2].y() + v[0].x()*v[1].y() - v[1].x()*v[0].y());
-    return {c1,c2,c3};
+// Screen z is ndc z mapped linearly onto [DEPTH_RANGE_NEAR, DEPTH_RANGE_FAR], the
+// viewport's depth range as glDepthRange sets it. It does not depend on the near and
+// far plane: set_projection only accepts projections that put them at ndc z -1 and 1,
+// so whatever survives clipping lands inside this range.
+constexpr float DEPTH_RANGE_NEAR = 0.0f;
+constexpr float DEPTH_RANGE_FAR = 1.0f;
+
+// D24/D16 store floor((z - depth_min) / depth_step), where depth_min and depth_step
+// span the depth range. The largest value means nothing drawn yet. Unpacking gives the near end of the step, which makes "z < unpacked" the same
+// test as "packed z < stored", so the float span kernels and Hi-Z run unchanged on
+// unpacked rows.
+static uint32_t depth_empty(rst::DepthFormat format)
+{
+    return format == rst::DepthFormat::D16 ? 0xffffu : 0xffffffu;
 }
 
-void rst::rasterizer::draw(std::vector<Triangle *> &TriangleList) {
+// Triangles may reach this many pixels past each side of the viewport before they
+// are clipped in x/y; anything inside the guard band is left to the bounding box
+// clamp of the raster stage. Must stay well below MAX_SCREEN_COORD.
+constexpr float GUARD_BAND = float(1 << 16);
+
+// Vertex outcodes, one bit per plane the vertex is outside of. The guard band bits
+// imply the matching viewport bits.
+enum : uint32_t
+{
+    CLIP_NEAR = 1 << 0,
+    CLIP_FAR = 1 << 1,
+    CLIP_LEFT = 1 << 2,
+    CLIP_RIGHT = 1 << 3,
+    CLIP_BOTTOM = 1 << 4,
+    CLIP_TOP = 1 << 5,
+    GUARD_LEFT = 1 << 6,
+    GUARD_RIGHT = 1 << 7,
+    GUARD_BOTTOM = 1 << 8,
+    GUARD_TOP = 1 << 9,
+
+    // a triangle with all three vertices outside one of these planes is invisible
+    CLIP_REJECT = CLIP_NEAR | CLIP_FAR | CLIP_LEFT | CLIP_RIGHT | CLIP_BOTTOM | CLIP_TOP,
+    // only these planes are actually clipped against
+    CLIP_POLYGON = CLIP_NEAR | CLIP_FAR | GUARD_LEFT | GUARD_RIGHT | GUARD_BOTTOM | GUARD_TOP
+};
 
-    float f1 = (50 - 0.1) / 2.0;
-    float f2 = (50 + 0.1) / 2.0;
+// Clipping a triangle against the six CLIP_POLYGON planes adds at most one vertex per plane.
+constexpr int MAX_CLIP_VERTICES = 3 + 6;
+
+static Eigen::Vector4f viewport_transform(Eigen::Vector4f v, int width, int height)
+{
+    float f1 = (DEPTH_RANGE_FAR - DEPTH_RANGE_NEAR) / 2.0;
+    float f2 = (DEPTH_RANGE_FAR + DEPTH_RANGE_NEAR) / 2.0;
 
-    Eigen::Matrix4f mvp = projection * view * model;
-    for (const auto& t:TriangleList)
+    //Homogeneous division
+    v.x() /= v.w();
+    v.y() /= v.w();
+    v.z() /= v.w();
+
+    //Viewport transformation
+    v.x() = 0.5*width*(v.x()+1.0);
+    v.y() = 0.5*height*(v.y()+1.0);
+    v.z() = v.z() * f1 + f2;
+    return v;
+}
+
+// Signed distance of v to one clip plane, >= 0 on the visible side. Near and far are
+// planes of constant view space z. The side planes go through the eye and are tested
+// in clip space scaled by clip_sign, the sign w has in front of the camera, so the
+// tests hold for vertices behind the camera as well.
+float rst::rasterizer::clip_distance(const clip_vertex& v, uint32_t plane) const
+{
+    float w = clip_sign * v.clip.w();
+    float x = clip_sign * v.clip.x();
+    float y = clip_sign * v.clip.y();
+    switch (plane)
     {
-        Triangle newtri = *t;
+        case CLIP_NEAR: return -v.view_pos.z() - z_near;
+        case CLIP_FAR: return v.view_pos.z() + z_far;
+        case CLIP_LEFT: return w + x;
+        case CLIP_RIGHT: return w - x;
+        case CLIP_BOTTOM: return w + y;
+        case CLIP_TOP: return w - y;
+        case GUARD_LEFT: return guard_x * w + x;
+        case GUARD_RIGHT: return guard_x * w - x;
+        case GUARD_BOTTOM: return guard_y * w + y;
+        case GUARD_TOP: return guard_y * w - y;
+    }
+    return 0;
+}
 
-        std::array<Eigen::Vector4f, 3> mm {
-                (view * model * t->v[0]),
-                (view * model * t->v[1]),
-                (view * model * t->v[2])
-        };
+// True when all corners of the object space box are outside the same frustum plane,
+// so nothing inside it can be visible. Expects the clip setup of draw().
+bool rst::rasterizer::outside_frustum(const Eigen::AlignedBox3f& bounds) const
+{
+    const Eigen::Matrix4f mv = view * model;
+    const Eigen::Matrix4f mvp = projection * mv;
 
-        std::array<Eigen::Vector3f, 3> viewspace_pos;
+    uint32_t outside = CLIP_REJECT;
+    for (int i = 0; i < 8 && outside; ++i)
+    {
+        Eigen::Vector4f p = to_vec4(bounds.corner(Eigen::AlignedBox3f::CornerType(i)));
+        clip_vertex v;
+        v.view_pos = (mv * p).head<3>();
+        v.clip = mvp * p;
 
-        std::transform(mm.begin(), mm.end(), viewspace_pos.begin(), [](auto& v) {
-            return v.template head<3>();
-        });
+        uint32_t outcode = 0;
+        for (uint32_t plane = CLIP_NEAR; plane <= CLIP_TOP; plane <<= 1)
+            if (clip_distance(v, plane) < 0)
+                outcode |= plane;
+        outside &= outcode;
+    }
+    return outside != 0;
+}
 
-        Eigen::Vector4f v[] = {
-                mvp * t->v[0],
-                mvp * t->v[1],
-                mvp * t->v[2]
-        };
-        //Homogeneous division
-        for (auto& vec : v) {
-            vec.x()/=vec.w();
-            vec.y()/=vec.w();
-            vec.z()/=vec.w();
+// Vertex stage: everything that only depends on the draw call (matrices, viewport
+// constants) is computed once here, then each mesh vertex is transformed exactly
+// once into vertex_cache, together with its outcode. Triangles are assembled from
+// the cache afterwards.
+void rst::rasterizer::transform_vertices(const MeshView& mesh)
+{
+    constexpr int VERTICES_PER_JOB = 4096;
+
+    const Eigen::Matrix4f mv = view * model;
+    const Eigen::Matrix4f mvp = projection * mv;
+    const Eigen::Matrix4f inv_trans = mv.inverse().transpose();
+
+    vertex_cache.resize(mesh.vertex_count);
+
+    auto transform_range = [&](int job) {
+        RST_TRACE_ZONE("transform vertices");
+        size_t end = std::min(mesh.vertex_count, size_t(job + 1) * VERTICES_PER_JOB);
+        for (size_t i = size_t(job) * VERTICES_PER_JOB; i < end; ++i)
+        {
+            Eigen::Vector4f p = to_vec4(mesh.positions[i]);
+            transformed_vertex& out = vertex_cache[i];
+
+            clip_vertex v;
+            v.view_pos = (mv * p).head<3>();
+            v.clip = mvp * p;
+
+            out.view_pos = v.view_pos;
+            //view space normal
+            out.normal = (inv_trans * to_vec4(mesh.normals[i], 0.0f)).head<3>();
+            out.clip = v.clip;
+            out.screen = viewport_transform(v.clip, width, height);
+
+            out.outcode = 0;
+            for (uint32_t plane = CLIP_NEAR; plane <= GUARD_TOP; plane <<= 1)
+                if (clip_distance(v, plane) < 0)
+                    out.outcode |= plane;
         }
+    };
 
-        Eigen::Matrix4f inv_trans = (view * model).inverse().transpose();
-        Eigen::Vector4f n[] = {
-                inv_trans * to_vec4(t->normal[0], 0.0f),
-                inv_trans * to_vec4(t->normal[1], 0.0f),
-                inv_trans * to_vec4(t->normal[2], 0.0f)
-        };
+    int jobs = int((mesh.vertex_count + VERTICES_PER_JOB - 1) / VERTICES_PER_JOB);
+    if (pool)
+        pool->parallel_for(jobs, transform_range);
+    else
+        for (int job = 0; job < jobs; ++job)
+            transform_range(job);
+}
+
+// Fills st.attrs from the vertices of st.tri and the view space positions.
+static void setup_attributes(rst::screen_triangle& st, const std::array<Eigen::Vector3f, 3>& view_pos)
+{
+    const Triangle& t = st.tri;
+    rst::attribute_setup& a = st.attrs;
+
+    rst::attribute_setup::values f[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        float inv_w = 1.0f / t.v[i].w();
+        f[i] << 1.0f, t.color[i], t.normal[i], t.tex_coords[i], view_pos[i];
+        f[i] *= inv_w;
+    }
 
-        //Viewport transformation
-        for (auto & vert : v)
+    float dx1 = t.v[1].x() - t.v[0].x(), dy1 = t.v[1].y() - t.v[0].y();
+    float dx2 = t.v[2].x() - t.v[0].x(), dy2 = t.v[2].y() - t.v[0].y();
+    float det = dx1 * dy2 - dx2 * dy1;
+    float inv_det = det != 0 ? 1.0f / det : 0.0f;
+
+    a.x0 = t.v[0].x();
+    a.y0 = t.v[0].y();
+    a.origin = f[0];
+    a.ddx = ((f[1] - f[0]) * dy2 - (f[2] - f[0]) * dy1) * inv_det;
+    a.ddy = ((f[2] - f[0]) * dx1 - (f[1] - f[0]) * dx2) * inv_det;
+}
+
+// Builds the screen space triangles for mesh triangle tri into out, which must hold
+// MAX_CLIPPED_TRIANGLES, and returns how many there are. Triangles completely outside
+// one frustum plane produce none. Triangles inside near/far and the guard band are
+// passed through untouched; only the rest go through polygon clipping.
+int rst::rasterizer::assemble_triangle(const MeshView& mesh, size_t tri, screen_triangle* out, raster_stats& stats) const
+{
+    const uint32_t* idx = mesh.indices + 3 * tri;
+    const transformed_vertex* tv[] = {&vertex_cache[idx[0]], &vertex_cache[idx[1]], &vertex_cache[idx[2]]};
+
+    if (tv[0]->outcode & tv[1]->outcode & tv[2]->outcode & CLIP_REJECT)
+    {
+        stats.clip_rejected++;
+        return 0;
+    }
+
+    if (cull_mode != CullMode::None)
+    {
+        // Facing is decided in view space, where the eye is the origin: the triangle
+        // faces the camera when its normal points back towards the eye. Unlike the
+        // screen space winding this works before clipping, whatever sign w has.
+        const Eigen::Vector3f& a = tv[0]->view_pos;
+        Eigen::Vector3f n = (tv[1]->view_pos - a).cross(tv[2]->view_pos - a);
+        bool front = n.dot(a) < 0;
+        if (front == (cull_mode == CullMode::Front))
         {
-            vert.x() = 0.5*width*(vert.x()+1.0);
-            vert.y() = 0.5*height*(vert.y()+1.0);
-            vert.z() = vert.z() * f1 + f2;
+            stats.face_culled++;
+            return 0;
         }
+    }
 
+    if (!((tv[0]->outcode | tv[1]->outcode | tv[2]->outcode) & CLIP_POLYGON))
+    {
+        Triangle& newtri = out[0].tri;
         for (int i = 0; i < 3; ++i)
         {
             //screen space coordinates
-            newtri.setVertex(i, v[i]);
+            newtri.setVertex(i, tv[i]->screen);
+            newtri.setNormal(i, tv[i]->normal);
+            newtri.setTexCoord(i, mesh.tex_coords[idx[i]]);
+            newtri.setColor(i, 148,121.0,92.0);
+        }
+        setup_attributes(out[0], {tv[0]->view_pos, tv[1]->view_pos, tv[2]->view_pos});
+        return 1;
+    }
+
+    // Sutherland-Hodgman against the planes some vertex is outside of.
+    stats.clipped++;
+    clip_vertex poly[2][MAX_CLIP_VERTICES];
+    int n = 3;
+    for (int i = 0; i < 3; ++i)
+        poly[0][i] = {tv[i]->clip, tv[i]->view_pos, tv[i]->normal, mesh.tex_coords[idx[i]]};
+
+    uint32_t planes = (tv[0]->outcode | tv[1]->outcode | tv[2]->outcode) & CLIP_POLYGON;
+    int src = 0;
+    for (uint32_t plane = CLIP_NEAR; plane <= GUARD_TOP && n >= 3; plane <<= 1)
+    {
+        if (!(planes & plane))
+            continue;
+
+        const clip_vertex* in = poly[src];
+        clip_vertex* res = poly[src ^ 1];
+        int m = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            const clip_vertex& a = in[i];
+            const clip_vertex& b = in[(i + 1) % n];
+            float da = clip_distance(a, plane);
+            float db = clip_distance(b, plane);
+            if (da >= 0)
+                res[m++] = a;
+            if ((da >= 0) != (db >= 0))
+            {
+                // always interpolate from the inside vertex, so the two triangles
+                // sharing this edge compute the same new vertex
+                res[m++] = da >= 0 ? lerp(a, b, da / (da - db)) : lerp(b, a, db / (db - da));
+            }
         }
+        n = m;
+        src ^= 1;
+    }
 
+    // The clipped polygon is convex, emit it as a fan.
+    int count = 0;
+    for (int k = 1; k + 1 < n; ++k, ++count)
+    {
+        const clip_vertex* fan[] = {&poly[src][0], &poly[src][k], &poly[src][k + 1]};
+        Triangle& newtri = out[count].tri;
         for (int i = 0; i < 3; ++i)
         {
-            //view space normal
-            newtri.setNormal(i, n[i].head<3>());
+            newtri.setVertex(i, viewport_transform(fan[i]->clip, width, height));
+            newtri.setNormal(i, fan[i]->normal);
+            newtri.setTexCoord(i, fan[i]->tex_coords);
+            newtri.setColor(i, 148,121.0,92.0);
         }
+        setup_attributes(out[count], {fan[0]->view_pos, fan[1]->view_pos, fan[2]->view_pos});
+    }
+    return count;
+}
 
-        newtri.setColor(0, 148,121.0,92.0);
-        newtri.setColor(1, 148,121.0,92.0);
-        newtri.setColor(2, 148,121.0,92.0);
+// Vertices are snapped to a 1/16 pixel grid so the edge functions below are exact
+// integers: stepping them by addition never drifts and the fill rule is decided
+// exactly on shared edges.
+constexpr int SUBPIXEL_BITS = 4;
+constexpr int64_t SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+constexpr int64_t SUBPIXEL_HALF = SUBPIXEL_ONE / 2;
+// Largest screen coordinate we accept before snapping; anything further out is
+// not representable and the triangle is dropped.
+constexpr float MAX_SCREEN_COORD = float(1 << 20);
 
-        // Also pass view space vertice position
-        rasterize_triangle(newtri, viewspace_pos);
+struct edge_setup
+{
+    int64_t step_x[3];  // E_i(x + 1, y) - E_i(x, y)
+    int64_t step_y[3];  // E_i(x, y + 1) - E_i(x, y)
+    int64_t origin[3];  // E_i at the centre of pixel (rect.x0, rect.y0)
+    int64_t bias[3];    // 0 for edges owned by this triangle (top-left rule), 1 otherwise
+    float inv_area;     // 1 / sum of the edge functions, turns E_i into barycentrics
+    rst::screen_rect rect; // pixels whose centre may be covered, clipped to the target rect
+};
+
+static bool snap_vertices(const Triangle& t, int64_t (&x)[3], int64_t (&y)[3])
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        float fx = t.v[i].x(), fy = t.v[i].y();
+        if (!(std::abs(fx) < MAX_SCREEN_COORD && std::abs(fy) < MAX_SCREEN_COORD))
+            return false;
+        x[i] = std::llround(fx * SUBPIXEL_ONE);
+        y[i] = std::llround(fy * SUBPIXEL_ONE);
     }
+    return true;
 }
 
-static Eigen::Vector3f interpolate(float alpha, float beta, float gamma, const Eigen::Vector3f& vert1, const Eigen::Vector3f& vert2, const Eigen::Vector3f& vert3, float weight)
+// Pixels whose centre lies inside the snapped bounding box of t. Returns false for
+// triangles that cannot be rasterized (non-finite or too far off screen).
+static bool bounding_rect(const Triangle& t, rst::screen_rect& r)
 {
-    return (alpha * vert1 + beta * vert2 + gamma * vert3) / weight;
+    int64_t x[3], y[3];
+    if (!snap_vertices(t, x, y))
+        return false;
+
+    // pixel p is covered by [lo, hi] when lo <= p * ONE + HALF <= hi
+    auto first = [](int64_t lo) { return int((lo - SUBPIXEL_HALF + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS); };
+    auto last = [](int64_t hi) { return int((hi - SUBPIXEL_HALF) >> SUBPIXEL_BITS); };
+    r.x0 = first(std::min({x[0], x[1], x[2]}));
+    r.y0 = first(std::min({y[0], y[1], y[2]}));
+    r.x1 = last(std::max({x[0], x[1], x[2]})) + 1;
+    r.y1 = last(std::max({y[0], y[1], y[2]})) + 1;
+    return true;
 }
 
-static Eigen::Vector2f interpolate(float alpha, float beta, float gamma, const Eigen::Vector2f& vert1, const Eigen::Vector2f& vert2, const Eigen::Vector2f& vert3, float weight)
+static bool setup_edges(const Triangle& t, const rst::screen_rect& clip, edge_setup& e)
 {
-    auto u = (alpha * vert1[0] + beta * vert2[0] + gamma * vert3[0]);
-    auto v = (alpha * vert1[1] + beta * vert2[1] + gamma * vert3[1]);
+    int64_t x[3], y[3];
+    if (!snap_vertices(t, x, y) || !bounding_rect(t, e.rect))
+        return false;
+
+    e.rect.x0 = std::max(e.rect.x0, clip.x0);
+    e.rect.y0 = std::max(e.rect.y0, clip.y0);
+    e.rect.x1 = std::min(e.rect.x1, clip.x1);
+    e.rect.y1 = std::min(e.rect.y1, clip.y1);
+    if (e.rect.x0 >= e.rect.x1 || e.rect.y0 >= e.rect.y1)
+        return false;
 
-    u /= weight;
-    v /= weight;
+    // Edge i is opposite vertex i, so E_i / area is that vertex's barycentric weight.
+    int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0)
+        return false;
+    // Accept both windings: flip the edges of clockwise triangles so the inside is positive.
+    int64_t sign = area > 0 ? 1 : -1;
 
-    return Eigen::Vector2f(u, v);
+    int64_t px = e.rect.x0 * SUBPIXEL_ONE + SUBPIXEL_HALF;
+    int64_t py = e.rect.y0 * SUBPIXEL_ONE + SUBPIXEL_HALF;
+    for (int i = 0; i < 3; ++i)
+    {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        // E(p) = a * p.x + b * p.y + c for the directed edge v_j -> v_k
+        int64_t a = sign * (y[j] - y[k]);
+        int64_t b = sign * (x[k] - x[j]);
+        e.step_x[i] = a * SUBPIXEL_ONE;
+        e.step_y[i] = b * SUBPIXEL_ONE;
+        e.origin[i] = a * (px - x[j]) + b * (py - y[j]);
+        // Top-left rule: a pixel centre exactly on an edge belongs to the triangle only
+        // for left edges (a > 0) and top edges (a == 0, b < 0), so two triangles sharing
+        // an edge never both shade it.
+        bool owned = a > 0 || (a == 0 && b < 0);
+        e.bias[i] = owned ? 0 : 1;
+    }
+    e.inv_area = 1.0f / float(area * sign);
+    return true;
+}
+
+// True when every edge value over e.rect fits in int32. The edge functions are linear,
+// so checking the corners of the rect is enough.
+static bool fits_int32(const edge_setup& e)
+{
+    int64_t dx = e.rect.x1 - 1 - e.rect.x0;
+    int64_t dy = e.rect.y1 - 1 - e.rect.y0;
+    for (int i = 0; i < 3; ++i)
+    {
+        int64_t corners[] = {
+            e.origin[i],
+            e.origin[i] + dx * e.step_x[i],
+            e.origin[i] + dy * e.step_y[i],
+            e.origin[i] + dx * e.step_x[i] + dy * e.step_y[i],
+            e.step_x[i]
+        };
+        for (int64_t c : corners)
+            if (c < INT32_MIN || c > INT32_MAX)
+                return false;
+    }
+    return true;
+}
+
+#ifdef RST_TRACE
+// Pixels of a span inside the triangle whatever their depth. The span kernels test
+// coverage and depth in one go, so only trace builds count this separately.
+static int covered_in_span(const edge_setup& e, const int64_t (&w)[3], int n)
+{
+    int covered = 0;
+    for (int i = 0; i < n; ++i)
+        covered += w[0] + i * e.step_x[0] >= e.bias[0] && w[1] + i * e.step_x[1] >= e.bias[1] &&
+                   w[2] + i * e.step_x[2] >= e.bias[2];
+    return covered;
+}
+#endif
+
+// Span test for triangles too large for the 32-bit kernels; same depth expression.
+static uint64_t raster_span_wide(const edge_setup& e, const rst::span_setup& s, const int64_t (&w)[3], int n, float* depth)
+{
+    uint64_t result = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        int64_t e0 = w[0] + i * e.step_x[0];
+        int64_t e1 = w[1] + i * e.step_x[1];
+        int64_t e2 = w[2] + i * e.step_x[2];
+        if (e0 >= e.bias[0] && e1 >= e.bias[1] && e2 >= e.bias[2])
+        {
+            float alpha = float(e0) * s.inv_area;
+            float beta = float(e1) * s.inv_area;
+            float gamma = float(e2) * s.inv_area;
+            float z = alpha * s.z[0] + beta * s.z[1] + gamma * s.z[2];
+            if (z < depth[i])
+            {
+                depth[i] = z;
+                result |= uint64_t(1) << i;
+            }
+        }
+    }
+    return result;
+}
+
+void rst::rasterizer::draw(const MeshView& mesh)
+{
+    draw(mesh, [this](const fragment_shader_payload& payload) { return fragment_shader(payload); });
+}
+
+void rst::rasterizer::draw_mesh(const MeshView& mesh, const shading_pass& pass) {
+    RST_TRACE_ZONE("draw");
+
+    constexpr int TRIANGLES_PER_JOB = 1024;
+
+    int count = int(mesh.triangle_count());
+    bool binned = pool && pool->size() > 1;
+    screen_rect screen{0, 0, width, height};
+
+    // The camera looks down -z, w of a point straight ahead tells which sign w has
+    // on the visible side of this projection.
+    clip_sign = (projection * Eigen::Vector4f(0, 0, -1, 1)).w() < 0 ? -1.0f : 1.0f;
+    guard_x = 1 + 2 * GUARD_BAND / width;
+    guard_y = 1 + 2 * GUARD_BAND / height;
+
+    // Ends the stage that started at the previous lap, only read when timing.
+    using clock = std::chrono::steady_clock;
+    clock::time_point stage_start = stage_timing ? clock::now() : clock::time_point();
+    auto lap = [&](double& stage) {
+        if (!stage_timing)
+            return;
+        clock::time_point now = clock::now();
+        stage += std::chrono::duration<double, std::milli>(now - stage_start).count();
+        stage_start = now;
+    };
+
+    if (frustum_culling && !mesh.bounds.isEmpty() && outside_frustum(mesh.bounds))
+    {
+        frame_stats.frustum_culled += count;
+        lap(frame_timings.clip);
+        return;
+    }
+
+    transform_vertices(mesh);
+    lap(frame_timings.vertex);
+
+    if (!binned && !deferred && !stage_timing)
+    {
+        screen_triangle st[MAX_CLIPPED_TRIANGLES];
+        for (int i = 0; i < count; ++i)
+        {
+            int n = assemble_triangle(mesh, i, st, frame_stats);
+
+            // Also pass view space vertice position
+            for (int j = 0; j < n; ++j)
+                rasterize_triangle(st[j], 0, screen, frame_stats, pass);
+        }
+        return;
+    }
+
+    // Assemble everything up front, the binned raster and the deferred resolve both
+    // refer back to screen_tris by index. Clipping changes the number of triangles,
+    // so every job fills its own list and the lists are joined in submission order.
+    // All of these keep their capacity across frames.
+    int jobs = (count + TRIANGLES_PER_JOB - 1) / TRIANGLES_PER_JOB;
+    if (int(assembled.size()) < jobs)
+        assembled.resize(jobs);
+
+    auto assemble = [&](int job) {
+        RST_TRACE_ZONE("assemble");
+        auto& list = assembled[job];
+        list.clear();
+        raster_stats local;
+        screen_triangle st[MAX_CLIPPED_TRIANGLES];
+        int end = std::min(count, (job + 1) * TRIANGLES_PER_JOB);
+        for (int i = job * TRIANGLES_PER_JOB; i < end; ++i)
+        {
+            int n = assemble_triangle(mesh, i, st, local);
+            list.insert(list.end(), st, st + n);
+        }
+
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        frame_stats += local;
+    };
+    if (pool)
+        pool->parallel_for(jobs, assemble);
+    else
+        for (int job = 0; job < jobs; ++job)
+            assemble(job);
+
+    screen_tris.clear();
+    for (int job = 0; job < jobs; ++job)
+        screen_tris.insert(screen_tris.end(), assembled[job].begin(), assembled[job].end());
+    lap(frame_timings.clip);
+
+    if (binned)
+        raster_binned(pass);
+    else
+        for (int i = 0; i < int(screen_tris.size()); ++i)
+            rasterize_triangle(screen_tris[i], i, screen, frame_stats, pass);
+    lap(frame_timings.raster);
+
+    if (deferred)
+    {
+        pass.resolve(*this, pass.shader);
+        lap(frame_timings.shade);
+    }
+}
+
+// Append every triangle's index to the bins of all tiles its bounding box touches.
+// Bins keep submission order, so per pixel the depth test sees triangles in the same
+// order as the serial path. Workers then pick whole tiles and rasterize the tile's
+// bin clipped to the tile.
+void rst::rasterizer::raster_binned(const shading_pass& pass)
+{
+    for (auto& bin : tile_bins)
+        bin.clear();
+
+    for (int i = 0; i < int(screen_tris.size()); ++i)
+    {
+        screen_rect r;
+        if (!bounding_rect(screen_tris[i].tri, r))
+            continue;
+        r.x0 = std::max(r.x0, 0);
+        r.y0 = std::max(r.y0, 0);
+        r.x1 = std::min(r.x1, width);
+        r.y1 = std::min(r.y1, height);
+        if (r.x0 >= r.x1 || r.y0 >= r.y1)
+            continue;
+
+        for (int ty = r.y0 / TILE_SIZE; ty <= (r.y1 - 1) / TILE_SIZE; ++ty)
+            for (int tx = r.x0 / TILE_SIZE; tx <= (r.x1 - 1) / TILE_SIZE; ++tx)
+                tile_bins[ty * tiles_x + tx].push_back(i);
+    }
+
+    pool->parallel_for(tiles_x * tiles_y, [&](int tile) {
+        RST_TRACE_ZONE("raster tile");
+        int tx = tile % tiles_x;
+        int ty = tile / tiles_x;
+        screen_rect rect{tx * TILE_SIZE, ty * TILE_SIZE,
+                         std::min((tx + 1) * TILE_SIZE, width), std::min((ty + 1) * TILE_SIZE, height)};
+        raster_stats local;
+        for (int i : tile_bins[tile])
+            rasterize_triangle(screen_tris[i], i, rect, local, pass);
+
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        frame_stats += local;
+    });
 }
 
 //Screen space rasterization
-void rst::rasterizer::rasterize_triangle(const Triangle& t, const std::array<Eigen::Vector3f, 3>& view_pos) 
+void rst::rasterizer::rasterize_triangle(const screen_triangle& st, uint32_t id, const screen_rect& rect,
+                                         raster_stats& stats, const shading_pass& pass)
 {
+    const Triangle& t = st.tri;
+
     // TODO: From your HW3, get the triangle rasterization code.
     // TODO: Inside your rasterization loop:
     //    * v[i].w() is the vertex view space depth value z.
@@ -280,56 +768,179 @@ void rst::rasterizer::rasterize_triangle(const Triangle& t, const std::array<Eig
     // Use: Instead of passing the triangle's color directly to the frame buffer, pass the color to the shaders first to get the final color;
     // Use: auto pixel_color = fragment_shader(payload);
 
-    auto v = t.toVector4();
+    RST_TRACE_ZONE("rasterize_triangle");
+    RST_TRACE_COUNT(triangles, 1);
 
-    int min_x = INT_MAX;
-    int max_x = INT_MIN;
-    int min_y = INT_MAX;
-    int max_y = INT_MIN;
+    // Set the edge functions up once, then step them across the clipped bounding box.
+    edge_setup e;
+    if (!setup_edges(t, rect, e))
+        return;
 
-    for(auto point: v) { // bouding box
-        if (point[0] < min_x) min_x = point[0];
-        if (point[0] > max_x) max_x = point[0];
-        if (point[1] < min_y) min_y = point[1];
-        if (point[1] > max_y) max_y = point[1];
+    span_setup s;
+    s.inv_area = e.inv_area;
+    for (int i = 0; i < 3; ++i)
+    {
+        s.z[i] = t.v[i].z();
+        s.step_x[i] = int32_t(e.step_x[i]);
+        s.bias[i] = int32_t(e.bias[i]);
     }
+    // Small triangles go through the 32-bit span kernels, the rest through the int64 one.
+    span_kernel kernel = fits_int32(e) ? span_fn : nullptr;
 
-    for(int x = min_x; x< max_x; x++){
-        for(int y=min_y; y<max_y; y++){
-            // Normal
-            // insideTriangle(x+0.5f, y+0.5f, t.v)
-            if(insideTriangle((float)x + 0.5f, (float)y + 0.5f, t.v)){
-                auto abg = computeBarycentric2D(x+0.5f,y+0.5f,t.v);
-                float alpha = std::get<0>(abg);
-                float beta = std::get<1>(abg);
-                float gamma = std::get<2>(abg);
-
-                float w_reciprocal = 1.0/(alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
-                float z_interpolated = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
-                z_interpolated *= w_reciprocal;
-
-                //判断当前z值是否小于原来z表此位置的z值
-                if(z_interpolated < depth_buf[get_index(x,y)]) {
-                    Eigen::Vector2i p = {(float)x, (float)y};
-
-                    // 颜色插值
-                    auto interpolated_color = interpolate(alpha, beta, gamma, t.color[0], t.color[1], t.color[2], 1);
-                    // 法向量插值
-                    auto interpolated_normal = interpolate(alpha, beta, gamma, t.normal[0], t.normal[1], t.normal[2], 1);
-                    // 纹理颜色插值
-                    auto interpolated_texcoords = interpolate(alpha, beta, gamma, t.tex_coords[0], t.tex_coords[1], t.tex_coords[2], 1);
-                    // 内部点位置插值
-                    auto interpolated_shadingcoords = interpolate(alpha, beta, gamma, view_pos[0], view_pos[1], view_pos[2], 1);
-                    fragment_shader_payload payload(interpolated_color, interpolated_normal.normalized(), interpolated_texcoords, texture ? &*texture : nullptr);
-                    payload.view_pos = interpolated_shadingcoords;
-
-                    auto pixel_color = fragment_shader(payload);
-                    set_pixel(p, pixel_color);
-                    depth_buf[get_index(x,y)] = z_interpolated; // update z
+    // Nothing inside the triangle can be nearer than its nearest vertex. The margin
+    // covers the rounding of the interpolated depth, so Hi-Z never rejects a pixel
+    // the per-pixel test would have accepted.
+    float z_min = std::min({s.z[0], s.z[1], s.z[2]});
+    float z_max = std::max({s.z[0], s.z[1], s.z[2]});
+    z_min -= 8 * std::numeric_limits<float>::epsilon() * std::max(std::abs(z_min), std::abs(z_max));
+
+    // Walk the triangle in the HIZ_SIZE blocks of the Hi-Z grid.
+    bool any_visible = false;
+    bool rejected_by_hiz = false; // some block was touched but occluded, not just missed
+    for (int by = e.rect.y0 / HIZ_SIZE; by <= (e.rect.y1 - 1) / HIZ_SIZE; ++by) {
+        int y0 = std::max(by * HIZ_SIZE, e.rect.y0);
+        int y1 = std::min(by * HIZ_SIZE + HIZ_SIZE, e.rect.y1);
+        for (int bx = e.rect.x0 / HIZ_SIZE; bx <= (e.rect.x1 - 1) / HIZ_SIZE; ++bx) {
+            int x0 = std::max(bx * HIZ_SIZE, e.rect.x0);
+            int x1 = std::min(bx * HIZ_SIZE + HIZ_SIZE, e.rect.x1);
+
+            // edge values at the first pixel of the block
+            int64_t w[3];
+            for (int i = 0; i < 3; ++i)
+                w[i] = e.origin[i] + (x0 - e.rect.x0) * e.step_x[i] + (y0 - e.rect.y0) * e.step_y[i];
+
+            // skip blocks the triangle does not touch: some edge is negative on all corners
+            bool outside = false;
+            for (int i = 0; i < 3; ++i)
+                outside |= w[i] + std::max<int64_t>(e.step_x[i], 0) * (x1 - 1 - x0) +
+                           std::max<int64_t>(e.step_y[i], 0) * (y1 - 1 - y0) < e.bias[i];
+            if (outside)
+                continue;
+
+            float& hiz = hiz_buf[by * hiz_w + bx];
+            if (z_min >= hiz) {
+                stats.occluded_tiles++;
+                rejected_by_hiz = true;
+                continue;
+            }
+            any_visible = true;
+
+            int tile = (by * HIZ_SIZE / TILE_SIZE) * tiles_x + bx * HIZ_SIZE / TILE_SIZE;
+            prepare_tile(tile);
+
+            bool written = false;
+            for (int y = y0; y < y1; ++y) {
+                int n = x1 - x0;
+                // coverage, z and depth test (with depth write) for the block row at once
+                int index = get_index(x0, y);
+                float unpacked[HIZ_SIZE];
+                float* depth = depth_fmt == DepthFormat::D32F ? &depth_buf[index] : unpack_depth(index, n, unpacked);
+                uint64_t mask;
+                if (kernel) {
+                    int32_t w32[3] = {int32_t(w[0]), int32_t(w[1]), int32_t(w[2])};
+                    mask = kernel(s, w32, n, depth);
+                } else {
+                    mask = raster_span_wide(e, s, w, n, depth);
                 }
+                if (depth == unpacked)
+                    pack_depth(index, unpacked, mask);
+                written |= mask != 0;
+                stats.depth_passed += __builtin_popcountll(mask);
+                RST_TRACE_COUNT(covered_pixels, covered_in_span(e, w, n));
+                RST_TRACE_COUNT(depth_passed, __builtin_popcountll(mask));
+
+                // only the surviving pixels are shaded
+                if (deferred) {
+                    // keep only what the resolve pass needs; a nearer triangle may still overwrite it
+                    for (uint64_t m = mask; m; m &= m - 1)
+                        vis_buf[get_index(x0 + __builtin_ctzll(m), y)] = id;
+                } else if (mask) {
+                    pass.shade_span(*this, pass.shader, st, x0, y, mask, stats);
+                }
+
+                for (int i = 0; i < 3; ++i)
+                    w[i] += e.step_y[i];
+            }
+
+            // Depth only ever decreases, so a stale Hi-Z value is still conservative;
+            // refresh it from the whole block once this triangle wrote to it.
+            if (written) {
+                hiz = block_max_depth(bx, by);
+                // deferred mode shades exactly the pixels that passed here
+                color_tiles[tile] = depth_tiles[tile] = TILE_WRITTEN;
             }
         }
     }
+
+    // slivers between pixel centres touch no block and are not Hi-Z's doing
+    if (rejected_by_hiz && !any_visible)
+        stats.occluded_triangles++;
+}
+
+float rst::rasterizer::block_max_depth(int bx, int by)
+{
+    int x0 = bx * HIZ_SIZE, x1 = std::min(x0 + HIZ_SIZE, width);
+    int y0 = by * HIZ_SIZE, y1 = std::min(y0 + HIZ_SIZE, height);
+    if (depth_fmt != DepthFormat::D32F) {
+        // unpacking is monotonic, the farthest stored value gives the farthest depth
+        uint32_t stored = 0;
+        for (int y = y0; y < y1; ++y)
+            for (int x = x0; x < x1; ++x)
+                stored = std::max(stored, stored_depth(get_index(x, y)));
+        return unpack_depth_value(stored);
+    }
+    float z = -std::numeric_limits<float>::infinity();
+    for (int y = y0; y < y1; ++y) {
+        const float* row = &depth_buf[get_index(x0, y)];
+        for (int x = 0; x < x1 - x0; ++x)
+            z = std::max(z, row[x]);
+    }
+    return z;
+}
+
+float rst::rasterizer::unpack_depth_value(uint32_t stored) const
+{
+    if (stored == depth_empty(depth_fmt))
+        return std::numeric_limits<float>::infinity();
+    return depth_min + float(stored) * depth_step;
+}
+
+uint32_t rst::rasterizer::pack_depth_value(float z) const
+{
+    float steps = std::floor((z - depth_min) / depth_step);
+    return uint32_t(std::clamp(steps, 0.0f, float(depth_empty(depth_fmt) - 1)));
+}
+
+uint32_t rst::rasterizer::stored_depth(int index) const
+{
+    if (depth_fmt == DepthFormat::D16)
+        return depth16[index];
+    const uint8_t* p = &depth24[3 * size_t(index)];
+    return p[0] | p[1] << 8 | p[2] << 16;
+}
+
+float* rst::rasterizer::unpack_depth(int index, int n, float* row) const
+{
+    for (int i = 0; i < n; ++i)
+        row[i] = unpack_depth_value(stored_depth(index + i));
+    return row;
+}
+
+void rst::rasterizer::pack_depth(int index, const float* row, uint64_t mask)
+{
+    for (; mask; mask &= mask - 1) {
+        int i = __builtin_ctzll(mask);
+        // never farther than before, whatever the rounding of the packed value
+        uint32_t stored = std::min(pack_depth_value(row[i]), stored_depth(index + i));
+        if (depth_fmt == DepthFormat::D16) {
+            depth16[index + i] = uint16_t(stored);
+        } else {
+            uint8_t* p = &depth24[3 * size_t(index + i)];
+            p[0] = uint8_t(stored);
+            p[1] = uint8_t(stored >> 8);
+            p[2] = uint8_t(stored >> 16);
+        }
+    }
 }
 
 void rst::rasterizer::set_model(const Eigen::Matrix4f& m)
@@ -345,17 +956,201 @@ void rst::rasterizer::set_view(const Eigen::Matrix4f& v)
 void rst::rasterizer::set_projection(const Eigen::Matrix4f& p)
 {
     projection = p;
+
+    // The near and far planes are where ndc z reaches -1 and 1. Clip z and w only
+    // depend on view z for perspective and orthographic projections, so
+    // ndc z = (a z + b) / (c z + d) solves for the view z of either plane.
+    float a = p(2, 2), b = p(2, 3), c = p(3, 2), d = p(3, 3);
+    float ahead = d - c; // w of view z = -1
+    float distance[2];
+    for (int i = 0; i < 2; ++i) {
+        float ndc = i == 0 ? -1.0f : 1.0f;
+        float z = (ndc * d - b) / (a - ndc * c);
+        // w changes sign at the eye, a plane behind it would clip away the whole view
+        if (!std::isfinite(z) || (c * z + d) * ahead <= 0)
+            throw std::invalid_argument("set_projection: near or far plane is not in front of the eye");
+        distance[i] = -z;
+    }
+    // the depth test keeps the smaller screen z, so ndc z has to grow with distance
+    if (!(distance[0] < distance[1]))
+        throw std::invalid_argument("set_projection: projection does not map near to ndc z -1 and far to 1");
+    z_near = distance[0];
+    z_far = distance[1];
+}
+
+void rst::rasterizer::set_cull_mode(CullMode mode)
+{
+    cull_mode = mode;
+}
+
+void rst::rasterizer::set_frustum_culling(bool enable)
+{
+    frustum_culling = enable;
+}
+
+void rst::rasterizer::set_threads(int n)
+{
+    pool = n > 1 ? std::make_unique<ThreadPool>(n) : nullptr;
+}
+
+void rst::rasterizer::set_deferred(bool enable)
+{
+    deferred = enable;
+    vis_buf.assign(enable ? width * height : 0, VISIBILITY_EMPTY);
+}
+
+void rst::rasterizer::set_color_format(ColorFormat format)
+{
+    color_fmt = format;
+    if (format == ColorFormat::RGB32F) {
+        packed_image = cv::Mat();
+        packed_color = nullptr;
+        parked_images.clear();
+        frame_buf.assign(size_t(width) * height, Eigen::Vector3f{0, 0, 0});
+        std::fill(color_tiles.begin(), color_tiles.end(), TILE_CLEAR);
+    } else {
+        std::vector<Eigen::Vector3f>().swap(frame_buf);
+        parked_images.clear();
+        new_packed_image();
+    }
+}
+
+void rst::rasterizer::set_depth_format(DepthFormat format)
+{
+    depth_fmt = format;
+    size_t pixels = size_t(width) * height;
+    if (format == DepthFormat::D32F)
+        depth_buf.assign(pixels, std::numeric_limits<float>::infinity());
+    else
+        std::vector<float>().swap(depth_buf);
+    if (format == DepthFormat::D16)
+        depth16.assign(pixels, uint16_t(depth_empty(format)));
+    else
+        std::vector<uint16_t>().swap(depth16);
+    if (format == DepthFormat::D24)
+        depth24.assign(3 * pixels, 0xff);
+    else
+        std::vector<uint8_t>().swap(depth24);
+    std::fill(depth_tiles.begin(), depth_tiles.end(), TILE_CLEAR);
+    std::fill(hiz_buf.begin(), hiz_buf.end(), std::numeric_limits<float>::infinity());
+    depth_min = DEPTH_RANGE_NEAR;
+    depth_step = (DEPTH_RANGE_FAR - DEPTH_RANGE_NEAR) / float(depth_empty(format));
+}
+
+void rst::rasterizer::new_packed_image()
+{
+    packed_image = cv::Mat(height, width, CV_8UC4);
+    packed_color = reinterpret_cast<uint32_t*>(packed_image.data);
+    image_shared = false;
+    std::fill(color_tiles.begin(), color_tiles.end(), TILE_STALE);
+}
+
+// At most this many handed out buffers are kept for reuse; past that the oldest is
+// left to whoever still holds it.
+constexpr size_t MAX_PARKED_IMAGES = 3;
+
+void rst::rasterizer::next_packed_image()
+{
+    // Whoever holds the last color_image() keeps it intact. Park it and draw into a
+    // buffer nobody holds any more, which only needs the tiles it was written in
+    // refilled; a new buffer starts out stale everywhere.
+    parked_images.push_back({std::move(packed_image), std::move(color_tiles)});
+    auto free = std::find_if(parked_images.begin(), parked_images.end(), [](const parked_image& parked) {
+        return parked.image.u && parked.image.u->refcount == 1;
+    });
+    if (free != parked_images.end())
+    {
+        packed_image = std::move(free->image);
+        color_tiles = std::move(free->tiles);
+        parked_images.erase(free);
+        packed_color = reinterpret_cast<uint32_t*>(packed_image.data);
+        image_shared = false;
+        return;
+    }
+    if (parked_images.size() > MAX_PARKED_IMAGES)
+        parked_images.erase(parked_images.begin());
+    color_tiles.resize(tiles_x * tiles_y);
+    new_packed_image();
+}
+
+void rst::rasterizer::clear_color()
+{
+    if (image_shared)
+        next_packed_image();
+    for (uint8_t& tile : color_tiles)
+        if (tile == TILE_WRITTEN)
+            tile = TILE_STALE;
+}
+
+void rst::rasterizer::clear_depth()
+{
+    for (uint8_t& tile : depth_tiles)
+        if (tile == TILE_WRITTEN)
+            tile = TILE_STALE;
+    std::fill(hiz_buf.begin(), hiz_buf.end(), std::numeric_limits<float>::infinity());
+}
+
+rst::screen_rect rst::rasterizer::tile_rect(int tile) const
+{
+    int tx = tile % tiles_x, ty = tile / tiles_x;
+    return {tx * TILE_SIZE, ty * TILE_SIZE, std::min((tx + 1) * TILE_SIZE, width),
+            std::min((ty + 1) * TILE_SIZE, height)};
+}
+
+void rst::rasterizer::fill_color_tile(int tile)
+{
+    screen_rect r = tile_rect(tile);
+    uint32_t packed = pack_color({0, 0, 0}, color_fmt);
+    for (int y = r.y0; y < r.y1; ++y) {
+        int index = get_index(r.x0, y);
+        if (color_fmt == ColorFormat::RGB32F)
+            std::fill_n(&frame_buf[index], r.x1 - r.x0, Eigen::Vector3f{0, 0, 0});
+        else
+            std::fill_n(&packed_color[index], r.x1 - r.x0, packed);
+    }
+    color_tiles[tile] = TILE_CLEAR;
+}
+
+void rst::rasterizer::fill_depth_tile(int tile)
+{
+    screen_rect r = tile_rect(tile);
+    for (int y = r.y0; y < r.y1; ++y) {
+        int index = get_index(r.x0, y);
+        if (depth_fmt == DepthFormat::D32F)
+            std::fill_n(&depth_buf[index], r.x1 - r.x0, std::numeric_limits<float>::infinity());
+        else if (depth_fmt == DepthFormat::D16)
+            std::fill_n(&depth16[index], r.x1 - r.x0, uint16_t(depth_empty(depth_fmt)));
+        else
+            std::fill_n(&depth24[3 * size_t(index)], 3 * (r.x1 - r.x0), 0xff);
+    }
+    depth_tiles[tile] = TILE_CLEAR;
+}
+
+void rst::rasterizer::flush_color_clears()
+{
+    for (int tile = 0; tile < int(color_tiles.size()); ++tile)
+        if (color_tiles[tile] == TILE_STALE)
+            fill_color_tile(tile);
+}
+
+std::vector<rst::screen_rect> rst::rasterizer::written_tiles() const
+{
+    std::vector<screen_rect> tiles;
+    for (int tile = 0; tile < int(color_tiles.size()); ++tile)
+        if (color_tiles[tile] == TILE_WRITTEN)
+            tiles.push_back(tile_rect(tile));
+    return tiles;
 }
 
 void rst::rasterizer::clear(rst::Buffers buff)
 {
     if ((buff & rst::Buffers::Color) == rst::Buffers::Color)
     {
-        std::fill(frame_buf.begin(), frame_buf.end(), Eigen::Vector3f{0, 0, 0});
+        clear_color();
     }
     if ((buff & rst::Buffers::Depth) == rst::Buffers::Depth)
     {
-        std::fill(depth_buf.begin(), depth_buf.end(), std::numeric_limits<float>::infinity());
+        clear_depth();
     }
 }
 
@@ -364,19 +1159,18 @@ rst::rasterizer::rasterizer(int w, int h) : width(w), height(h)
     frame_buf.resize(w * h);
     depth_buf.resize(w * h);
 
-    texture = std::nullopt;
-}
+    tiles_x = (w + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_y = (h + TILE_SIZE - 1) / TILE_SIZE;
+    tile_bins.resize(tiles_x * tiles_y);
+    // neither buffer holds anything meaningful yet
+    color_tiles.assign(tiles_x * tiles_y, TILE_STALE);
+    depth_tiles.assign(tiles_x * tiles_y, TILE_STALE);
 
-int rst::rasterizer::get_index(int x, int y)
-{
-    return (height-y)*width + x;
-}
+    hiz_w = (w + HIZ_SIZE - 1) / HIZ_SIZE;
+    hiz_h = (h + HIZ_SIZE - 1) / HIZ_SIZE;
+    hiz_buf.resize(hiz_w * hiz_h);
 
-void rst::rasterizer::set_pixel(const Vector2i &point, const Eigen::Vector3f &color)
-{
-    //old index: auto ind = point.y() + point.x() * width;
-    int ind = (height-point.y())*width + point.x();
-    frame_buf[ind] = color;
+    texture = std::nullopt;
 }
 
 void rst::rasterizer::set_vertex_shader(std::function<Eigen::Vector3f(vertex_shader_payload)> vert_shader)
@@ -5,11 +5,20 @@
 #pragma once
 
 #include <eigen3/Eigen/Eigen>
+#include <opencv2/opencv.hpp>
 #include <optional>
 #include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <type_traits>
 #include "global.hpp"
 #include "Shader.hpp"
 #include "Triangle.hpp"
+#include "Mesh.hpp"
+#include "ThreadPool.hpp"
+#include "rasterizer_simd.hpp"
+#include "Trace.hpp"
 
 using namespace Eigen;
 
@@ -37,6 +46,47 @@ namespace rst
         Triangle
     };
 
+    // Which triangles to drop by facing. Front faces have counter-clockwise vertices
+    // when seen from the camera.
+    enum class CullMode
+    {
+        None,
+        Back,
+        Front
+    };
+
+    // Layout of the color buffer. RGB32F keeps a float Eigen::Vector3f per pixel in
+    // frame_buffer(). The packed formats take 4 bytes: RGBA8 in B, G, R, A byte order,
+    // which is OpenCV's 8 bit BGRA, and RGB10A2 with red in the low 10 bits.
+    enum class ColorFormat
+    {
+        RGB32F,
+        RGBA8,
+        RGB10A2
+    };
+
+    // Layout of the depth buffer. D24 (3 bytes) and D16 keep fixed point depth between
+    // the near and far plane.
+    enum class DepthFormat
+    {
+        D32F,
+        D24,
+        D16
+    };
+
+    // Packs a color as fragment shaders return it, 0..255 per channel. Out of range
+    // values saturate and NaN becomes 0, rounding is to nearest even: the same as
+    // cv::Mat::convertTo to 8 bit.
+    inline uint32_t pack_color(const Eigen::Vector3f& color, ColorFormat format)
+    {
+        auto channel = [](float c, float max) {
+            return uint32_t(std::lrint(c > 0 ? std::min(c, 255.0f) * (max / 255.0f) : 0.0f));
+        };
+        if (format == ColorFormat::RGBA8)
+            return channel(color.z(), 255) | channel(color.y(), 255) << 8 | channel(color.x(), 255) << 16 | 0xffu << 24;
+        return channel(color.x(), 1023) | channel(color.y(), 1023) << 10 | channel(color.z(), 1023) << 20 | 3u << 30;
+    }
+
     /*
      * For the curious : The draw function takes two buffer id's as its arguments. These two structs
      * make sure that if you mix up with their orders, the compiler won't compile it.
@@ -57,6 +107,114 @@ namespace rst
         int col_id = 0;
     };
 
+    // Side length in pixels of the screen tiles used by the binned raster path.
+    constexpr int TILE_SIZE = 64;
+
+    // Side length in pixels of the blocks whose farthest depth the Hi-Z buffer keeps.
+    // Binned tiles are made of whole blocks, so each block has a single owner thread.
+    constexpr int HIZ_SIZE = 8;
+    static_assert(TILE_SIZE % HIZ_SIZE == 0, "tiles must be whole Hi-Z blocks");
+
+    // Work counters, accumulated until reset_stats().
+    struct raster_stats
+    {
+        uint64_t frustum_culled = 0;     // triangles of meshes whose bounds are outside the frustum
+        uint64_t clip_rejected = 0;      // triangles completely outside one clip plane
+        uint64_t face_culled = 0;        // triangles dropped by the cull mode
+        uint64_t clipped = 0;            // triangles that went through polygon clipping
+        uint64_t occluded_triangles = 0; // rejected by Hi-Z before any per-pixel work (per tile when binned)
+        uint64_t occluded_tiles = 0;     // Hi-Z blocks skipped for a triangle that touches them
+        uint64_t depth_passed = 0;       // fragments that passed the depth test
+        uint64_t shaded_pixels = 0;      // fragment shader invocations
+
+        raster_stats& operator+=(const raster_stats& o)
+        {
+            frustum_culled += o.frustum_culled;
+            clip_rejected += o.clip_rejected;
+            face_culled += o.face_culled;
+            clipped += o.clipped;
+            occluded_triangles += o.occluded_triangles;
+            occluded_tiles += o.occluded_tiles;
+            depth_passed += o.depth_passed;
+            shaded_pixels += o.shaded_pixels;
+            return *this;
+        }
+    };
+
+    // Wall clock time of every stage of draw() in milliseconds, accumulated like
+    // raster_stats while stage timing is on.
+    struct stage_timings
+    {
+        double vertex = 0; // vertex transform and outcodes
+        double clip = 0;   // culling, clipping and attribute setup
+        double raster = 0; // coverage and depth test, shading too unless deferred
+        double shade = 0;  // the deferred resolve pass
+    };
+
+    // Half-open pixel rectangle [x0, x1) x [y0, y1).
+    struct screen_rect
+    {
+        int x0, y0, x1, y1;
+    };
+
+    // Output of the vertex stage for one mesh vertex.
+    struct transformed_vertex
+    {
+        Eigen::Vector4f clip;
+        Eigen::Vector4f screen;   // viewport x, y and depth; w is still the clip space w
+        Eigen::Vector3f view_pos;
+        Eigen::Vector3f normal;   // view space
+        uint32_t outcode;         // clip planes the vertex is outside of
+    };
+
+    // Vertex of a triangle being clipped, every attribute is interpolated linearly.
+    struct clip_vertex
+    {
+        Eigen::Vector4f clip;
+        Eigen::Vector3f view_pos;
+        Eigen::Vector3f normal;
+        Eigen::Vector2f tex_coords;
+    };
+
+    // Most triangles a single mesh triangle can turn into after clipping.
+    constexpr int MAX_CLIPPED_TRIANGLES = 7;
+
+    // Screen space plane equations of 1/w and of every shaded attribute divided by w,
+    // set up once per triangle. Evaluating them at a pixel centre and dividing by the
+    // interpolated 1/w gives perspective-correct attributes for a few FMAs each.
+    struct attribute_setup
+    {
+        // 1/w, color, normal, tex_coords, view_pos
+        using values = Eigen::Matrix<float, 12, 1>;
+
+        values origin;   // at (x0, y0)
+        values ddx, ddy; // change per pixel in x and y
+        float x0, y0;
+    };
+
+    // Output of the front end: the triangle in screen space, with the clip space w
+    // of every vertex kept in v[i].w(), plus the attribute planes for shading.
+    struct screen_triangle
+    {
+        Triangle tri;
+        attribute_setup attrs;
+    };
+
+    // Deferred mode keeps one triangle id per pixel; the resolve pass gets everything
+    // else from the triangle's attribute planes.
+    constexpr uint32_t VISIBILITY_EMPTY = UINT32_MAX;
+
+    // True for shader types with a batched entry point,
+    //   void shade_batch(const fragment_shader_payload* in, int n, Eigen::Vector3f* out) const;
+    // draw<Shader> then hands them every fragment of a span (forward) or up to
+    // SPAN_PIXELS fragments of a row (deferred) in one call instead of one at a time.
+    template <typename Shader, typename = void>
+    struct has_shade_batch : std::false_type {};
+
+    template <typename Shader>
+    struct has_shade_batch<Shader, std::void_t<decltype(std::declval<const Shader&>().shade_batch(
+            std::declval<const fragment_shader_payload*>(), 0, std::declval<Eigen::Vector3f*>()))>> : std::true_type {};
+
     class rasterizer
     {
     public:
@@ -68,26 +226,170 @@ namespace rst
 
         void set_model(const Eigen::Matrix4f& m);
         void set_view(const Eigen::Matrix4f& v);
+        // Takes the near and far plane from p, which has to map them in front of the
+        // eye to ndc z -1 and 1; throws std::invalid_argument otherwise.
         void set_projection(const Eigen::Matrix4f& p);
 
+        void set_cull_mode(CullMode mode);
+        // Skip whole meshes whose bounding box is outside the view frustum.
+        void set_frustum_culling(bool enable);
+
         void set_texture(Texture tex) { texture = tex; }
+        // Read by fragment shaders through fragment_shader_payload::uniforms. Set it
+        // between draws, not from a shader.
+        void set_uniforms(const shader_uniforms& u)
+        {
+            uniform_block = u;
+            uniform_block.light_count = std::min(std::max(u.light_count, 0), MAX_LIGHTS);
+            uniform_block.ambient = u.ka.cwiseProduct(u.amb_light_intensity);
+        }
+        const shader_uniforms& uniforms() const { return uniform_block; }
 
         void set_vertex_shader(std::function<Eigen::Vector3f(vertex_shader_payload)> vert_shader);
         void set_fragment_shader(std::function<Eigen::Vector3f(fragment_shader_payload)> frag_shader);
 
-        void set_pixel(const Vector2i &point, const Eigen::Vector3f &color);
+        void set_pixel(const Vector2i &point, const Eigen::Vector3f &color)
+        {
+            int tile = (point.y() / TILE_SIZE) * tiles_x + point.x() / TILE_SIZE;
+            prepare_tile(tile);
+            color_tiles[tile] = TILE_WRITTEN;
+            write_pixel(point, color);
+        }
+
+        // Pixels are packed as they are shaded. Changing a format clears that buffer.
+        void set_color_format(ColorFormat format);
+        ColorFormat color_format() const { return color_fmt; }
+        void set_depth_format(DepthFormat format);
+        DepthFormat depth_format() const { return depth_fmt; }
+
+        // With more than one thread draw() bins triangles into TILE_SIZE tiles and every
+        // worker owns whole tiles of frame_buf/depth_buf. The image is identical to n = 1.
+        void set_threads(int n);
+
+        // Coverage and depth test run 8 (AVX2) or 4 (SSE2) pixels at a time when the CPU
+        // supports it; false forces the scalar kernel. Output is identical either way.
+        void set_simd(bool enable) { span_fn = select_span_kernel(enable); }
 
+        // Deferred mode: the raster pass only records a triangle id per pixel, a second
+        // pass runs the fragment shader once for every covered pixel.
+        void set_deferred(bool enable);
+
+        // Times every stage of draw(). The serial forward path then assembles all
+        // triangles before rasterizing any, like the other paths, so clipping and
+        // raster can be told apart. The image is the same either way.
+        void set_stage_timing(bool enable) { stage_timing = enable; }
+
+        // Only marks the tiles written since the last clear; each is filled with the
+        // clear value when a triangle first reaches it, or when the buffer is read.
         void clear(Buffers buff);
 
         void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type);
-        void draw(std::vector<Triangle *> &TriangleList);
+        // Draws every triangle of an indexed mesh. The vertex arrays are read in place,
+        // the mesh only has to stay alive for the duration of the call.
+        void draw(const MeshView& mesh);
+        // Same, shading with shader instead of the one set by set_fragment_shader:
+        // anything callable as Eigen::Vector3f(const fragment_shader_payload&), plus
+        // optionally shade_batch (see has_shade_batch). The shading loops are
+        // instantiated for Shader, so it can inline into them; only the step from the
+        // raster loop to a span of fragments stays an indirect call.
+        template <typename Shader>
+        void draw(const MeshView& mesh, const Shader& shader);
+
+        // Empty unless the color format is RGB32F.
+        std::vector<Eigen::Vector3f>& frame_buffer()
+        {
+            flush_color_clears();
+            return frame_buf;
+        }
+        // The packed color buffer as a height x width CV_8UC4 image, shared with the
+        // rasterizer (empty for RGB32F). The next clear(Buffers::Color) moves on to
+        // another buffer rather than overwriting this one, so a finished frame can go
+        // to another thread without a copy. Buffers come back into use once every
+        // copy of the image handed out has been released.
+        const cv::Mat& color_image()
+        {
+            flush_color_clears();
+            image_shared = packed_color != nullptr;
+            return packed_image;
+        }
+        // Tiles whose color was written since the last clear(Buffers::Color), clipped to
+        // the screen. Every other pixel holds the clear color.
+        std::vector<screen_rect> written_tiles() const;
+        // The RGB32F or packed color buffer as it is, without filling stale tiles first:
+        // only pixels inside written_tiles() are meaningful.
+        const Eigen::Vector3f* frame_data() const { return frame_buf.data(); }
+        const uint32_t* packed_data() const { return packed_color; }
 
-        std::vector<Eigen::Vector3f>& frame_buffer() { return frame_buf; }
+        const raster_stats& stats() const { return frame_stats; }
+        const stage_timings& timings() const { return frame_timings; }
+        void reset_stats()
+        {
+            frame_stats = raster_stats();
+            frame_timings = stage_timings();
+        }
 
     private:
         void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
 
-        void rasterize_triangle(const Triangle& t, const std::array<Eigen::Vector3f, 3>& world_pos);
+        void transform_vertices(const MeshView& mesh);
+        bool outside_frustum(const Eigen::AlignedBox3f& bounds) const;
+        int assemble_triangle(const MeshView& mesh, size_t tri, screen_triangle* out, raster_stats& stats) const;
+        float clip_distance(const clip_vertex& v, uint32_t plane) const;
+        // Entry points into the shading loops draw<Shader> instantiated, for the shader
+        // independent rest of the pipeline in rasterizer.cpp.
+        struct shading_pass
+        {
+            const void* shader;
+            // Shades the pixels x0 + i of row y for every bit i set in mask.
+            void (*shade_span)(rasterizer& r, const void* shader, const screen_triangle& st, int x0, int y,
+                               uint64_t mask, raster_stats& stats);
+            // Second pass of deferred mode.
+            void (*resolve)(rasterizer& r, const void* shader);
+        };
+
+        void draw_mesh(const MeshView& mesh, const shading_pass& pass);
+        void raster_binned(const shading_pass& pass);
+
+        void rasterize_triangle(const screen_triangle& st, uint32_t id, const screen_rect& rect, raster_stats& stats,
+                                const shading_pass& pass);
+        fragment_shader_payload fragment_payload(const screen_triangle& st, int x, int y);
+        template <typename Shader>
+        void shade_span(const Shader& shader, const screen_triangle& st, int x0, int y, uint64_t mask,
+                        raster_stats& stats);
+        template <typename Shader>
+        void resolve_visibility(const Shader& shader);
+        float block_max_depth(int bx, int by);
+        void write_pixel(const Vector2i& point, const Eigen::Vector3f& color)
+        {
+            int index = get_index(point.x(), point.y());
+            if (color_fmt == ColorFormat::RGB32F)
+                frame_buf[index] = color;
+            else
+                packed_color[index] = pack_color(color, color_fmt);
+        }
+        void clear_color();
+        void clear_depth();
+        void new_packed_image();
+        void next_packed_image();
+        // Fills the stale buffers of tile, before anything reads or writes it.
+        void prepare_tile(int tile)
+        {
+            if (color_tiles[tile] == TILE_STALE)
+                fill_color_tile(tile);
+            if (depth_tiles[tile] == TILE_STALE)
+                fill_depth_tile(tile);
+        }
+        void fill_color_tile(int tile);
+        void fill_depth_tile(int tile);
+        void flush_color_clears();
+        screen_rect tile_rect(int tile) const;
+        // D24/D16: the stored value of pixel index, and conversion of n pixels from
+        // index on to and from float depth for the span kernels.
+        float unpack_depth_value(uint32_t stored) const;
+        uint32_t pack_depth_value(float z) const;
+        uint32_t stored_depth(int index) const;
+        float* unpack_depth(int index, int n, float* row) const;
+        void pack_depth(int index, const float* row, uint64_t mask);
 
         // VERTEX SHADER -> MVP -> Clipping -> /.W -> VIEWPORT -> DRAWLINE/DRAWTRI -> FRAGSHADER
 
@@ -104,17 +406,226 @@ namespace rst
         std::map<int, std::vector<Eigen::Vector3f>> nor_buf;
 
         std::optional<Texture> texture;
+        shader_uniforms uniform_block;
 
         std::function<Eigen::Vector3f(fragment_shader_payload)> fragment_shader;
         std::function<Eigen::Vector3f(vertex_shader_payload)> vertex_shader;
 
+        ColorFormat color_fmt = ColorFormat::RGB32F;
         std::vector<Eigen::Vector3f> frame_buf;
+        cv::Mat packed_image;
+        uint32_t* packed_color = nullptr; // packed_image's pixels
+
+        DepthFormat depth_fmt = DepthFormat::D32F;
         std::vector<float> depth_buf;
-        int get_index(int x, int y);
+        std::vector<uint16_t> depth16;
+        std::vector<uint8_t> depth24; // little endian
+        // Screen z range of D24/D16, set by set_depth_format.
+        float depth_min = 0, depth_step = 0;
+        int get_index(int x, int y) const { return (height-1-y)*width + x; }
+
+        // Farthest depth of every HIZ_SIZE x HIZ_SIZE block of depth_buf, conservative.
+        std::vector<float> hiz_buf;
+        int hiz_w, hiz_h;
+
+        bool deferred = false;
+        std::vector<uint32_t> vis_buf;
+
+        raster_stats frame_stats;
+        std::mutex stats_mutex;
+
+        bool stage_timing = false;
+        stage_timings frame_timings;
 
         int width, height;
 
+        span_kernel span_fn = select_span_kernel();
+
+        std::unique_ptr<ThreadPool> pool;
+        std::vector<transformed_vertex> vertex_cache;
+        float clip_sign, guard_x, guard_y;
+        // View space distances of the near and far plane in front of the eye, taken
+        // from the projection by set_projection.
+        float z_near = 0.1f, z_far = 50.0f;
+        CullMode cull_mode = CullMode::None;
+        bool frustum_culling = true;
+        std::vector<std::vector<screen_triangle>> assembled;
+        std::vector<screen_triangle> screen_tris;
+        std::vector<std::vector<int>> tile_bins;
+        int tiles_x, tiles_y;
+
+        // Per TILE_SIZE tile and buffer: TILE_STALE tiles still hold pixels from before
+        // the last clear.
+        enum : uint8_t
+        {
+            TILE_CLEAR,
+            TILE_WRITTEN,
+            TILE_STALE
+        };
+        std::vector<uint8_t> color_tiles, depth_tiles;
+        bool image_shared = false; // color_image() handed out the current packed buffer
+
+        // Packed buffers color_image() handed out, each with its color_tiles, until
+        // nothing outside holds them any more and they can be drawn into again.
+        struct parked_image
+        {
+            cv::Mat image;
+            std::vector<uint8_t> tiles;
+        };
+        std::vector<parked_image> parked_images;
+
         int next_id = 0;
         int get_next_id() { return next_id++; }
     };
+
+    template <typename Shader>
+    void rasterizer::draw(const MeshView& mesh, const Shader& shader)
+    {
+        shading_pass pass;
+        pass.shader = &shader;
+        pass.shade_span = [](rasterizer& r, const void* s, const screen_triangle& st, int x0, int y, uint64_t mask,
+                             raster_stats& stats) {
+            r.shade_span(*static_cast<const Shader*>(s), st, x0, y, mask, stats);
+        };
+        pass.resolve = [](rasterizer& r, const void* s) { r.resolve_visibility(*static_cast<const Shader*>(s)); };
+        draw_mesh(mesh, pass);
+    }
+
+    inline fragment_shader_payload rasterizer::fragment_payload(const screen_triangle& st, int x, int y)
+    {
+        const attribute_setup& a = st.attrs;
+
+        // plane equations are evaluated at the pixel centre, like the edge functions
+        float px = x + 0.5f - a.x0;
+        float py = y + 0.5f - a.y0;
+        attribute_setup::values v = a.origin + a.ddx * px + a.ddy * py;
+        float w = 1.0f / v[0];
+
+        Eigen::Vector3f interpolated_color = v.segment<3>(1) * w;
+        Eigen::Vector3f interpolated_normal = v.segment<3>(4) * w;
+        Eigen::Vector2f interpolated_texcoords = v.segment<2>(7) * w;
+        Eigen::Vector3f interpolated_shadingcoords = v.segment<3>(9) * w;
+        fragment_shader_payload payload(interpolated_color, interpolated_normal.normalized(), interpolated_texcoords, texture ? &*texture : nullptr);
+        payload.view_pos = interpolated_shadingcoords;
+        payload.uniforms = &uniform_block;
+        // d(uv)/dx = (d(uv/w)/dx - uv * d(1/w)/dx) * w, likewise for y
+        payload.tex_coords_dx = (a.ddx.segment<2>(7) - interpolated_texcoords * a.ddx[0]) * w;
+        payload.tex_coords_dy = (a.ddy.segment<2>(7) - interpolated_texcoords * a.ddy[0]) * w;
+        return payload;
+    }
+
+    template <typename Shader>
+    void rasterizer::shade_span(const Shader& shader, const screen_triangle& st, int x0, int y, uint64_t mask,
+                                raster_stats& stats)
+    {
+        stats.shaded_pixels += __builtin_popcountll(mask);
+        if constexpr (has_shade_batch<Shader>::value)
+        {
+            fragment_shader_payload payloads[SPAN_PIXELS];
+            Eigen::Vector3f colors[SPAN_PIXELS];
+            int n = 0;
+            for (uint64_t m = mask; m; m &= m - 1)
+                payloads[n++] = fragment_payload(st, x0 + __builtin_ctzll(m), y);
+            {
+                RST_TRACE_ZONE("fragment shader");
+                RST_TRACE_COUNT(shader_calls, n);
+                shader.shade_batch(payloads, n, colors);
+            }
+            n = 0;
+            for (uint64_t m = mask; m; m &= m - 1)
+                write_pixel({x0 + __builtin_ctzll(m), y}, colors[n++]);
+        }
+        else
+        {
+            // one zone per span, a zone per pixel would mostly time the clock
+            RST_TRACE_ZONE("fragment shader");
+            RST_TRACE_COUNT(shader_calls, __builtin_popcountll(mask));
+            for (uint64_t m = mask; m; m &= m - 1)
+            {
+                int x = x0 + __builtin_ctzll(m);
+                fragment_shader_payload payload = fragment_payload(st, x, y);
+                write_pixel({x, y}, shader(payload));
+            }
+        }
+    }
+
+    // Second pass of deferred mode: shade every pixel the raster pass left a triangle id
+    // in, exactly once, then mark it empty again for the next draw call.
+    template <typename Shader>
+    void rasterizer::resolve_visibility(const Shader& shader)
+    {
+        constexpr int ROWS_PER_JOB = 16;
+        int jobs = (height + ROWS_PER_JOB - 1) / ROWS_PER_JOB;
+
+        auto resolve_rows = [&](int job) {
+            RST_TRACE_ZONE("resolve");
+            raster_stats local;
+            int y1 = std::min(height, (job + 1) * ROWS_PER_JOB);
+            for (int y = job * ROWS_PER_JOB; y < y1; ++y)
+            {
+                if constexpr (has_shade_batch<Shader>::value)
+                {
+                    // batched shaders get the row's fragments SPAN_PIXELS at a time
+                    fragment_shader_payload payloads[SPAN_PIXELS];
+                    Eigen::Vector3f colors[SPAN_PIXELS];
+                    int xs[SPAN_PIXELS];
+                    int n = 0;
+                    auto flush = [&] {
+                        {
+                            RST_TRACE_ZONE("fragment shader");
+                            RST_TRACE_COUNT(shader_calls, n);
+                            shader.shade_batch(payloads, n, colors);
+                        }
+                        for (int i = 0; i < n; ++i)
+                            write_pixel({xs[i], y}, colors[i]);
+                        n = 0;
+                    };
+                    for (int x = 0; x < width; ++x)
+                    {
+                        uint32_t& id = vis_buf[get_index(x, y)];
+                        if (id == VISIBILITY_EMPTY)
+                            continue;
+
+                        payloads[n] = fragment_payload(screen_tris[id], x, y);
+                        xs[n] = x;
+                        if (++n == SPAN_PIXELS)
+                            flush();
+                        local.shaded_pixels++;
+                        id = VISIBILITY_EMPTY;
+                    }
+                    if (n > 0)
+                        flush();
+                }
+                else
+                {
+                    // one zone per row, like shade_span does per span
+                    RST_TRACE_ZONE("fragment shader");
+                    for (int x = 0; x < width; ++x)
+                    {
+                        uint32_t& id = vis_buf[get_index(x, y)];
+                        if (id == VISIBILITY_EMPTY)
+                            continue;
+
+                        fragment_shader_payload payload = fragment_payload(screen_tris[id], x, y);
+                        write_pixel({x, y}, shader(payload));
+                        local.shaded_pixels++;
+                        id = VISIBILITY_EMPTY;
+                    }
+                }
+            }
+
+            // the batched branch counts its calls per batch
+            if constexpr (!has_shade_batch<Shader>::value)
+                RST_TRACE_COUNT(shader_calls, local.shaded_pixels);
+
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            frame_stats += local;
+        };
+
+        if (pool)
+            pool->parallel_for(jobs, resolve_rows);
+        else
+            for (int job = 0; job < jobs; ++job)
+                resolve_rows(job);
+    }
 }
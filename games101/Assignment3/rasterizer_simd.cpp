@@ -0,0 +1,117 @@
+//
+// Scalar and SSE2 span kernels plus runtime selection. The AVX2 kernel lives in
+// rasterizer_avx2.cpp, which is the only file built with AVX2 enabled.
+//
+
+#include "rasterizer_simd.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// All kernels compute depth with exactly this expression so they agree bit for bit.
+static inline float span_depth(const rst::span_setup& s, int32_t e0, int32_t e1, int32_t e2)
+{
+    float alpha = float(e0) * s.inv_area;
+    float beta = float(e1) * s.inv_area;
+    float gamma = float(e2) * s.inv_area;
+    return alpha * s.z[0] + beta * s.z[1] + gamma * s.z[2];
+}
+
+uint64_t rst::raster_span_scalar(const span_setup& s, const int32_t (&w)[3], int n, float* depth)
+{
+    uint64_t result = 0;
+    int32_t e0 = w[0], e1 = w[1], e2 = w[2];
+    for (int i = 0; i < n; ++i)
+    {
+        if (e0 >= s.bias[0] && e1 >= s.bias[1] && e2 >= s.bias[2])
+        {
+            float z = span_depth(s, e0, e1, e2);
+            if (z < depth[i])
+            {
+                depth[i] = z;
+                result |= uint64_t(1) << i;
+            }
+        }
+        // wrapping add: the step after the last pixel may leave the int32 range
+        e0 = int32_t(uint32_t(e0) + uint32_t(s.step_x[0]));
+        e1 = int32_t(uint32_t(e1) + uint32_t(s.step_x[1]));
+        e2 = int32_t(uint32_t(e2) + uint32_t(s.step_x[2]));
+    }
+    return result;
+}
+
+#if defined(__SSE2__)
+uint64_t rst::raster_span_sse2(const span_setup& s, const int32_t (&w)[3], int n, float* depth)
+{
+    const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i e[3], step4[3], bias[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        // lanes past the end of the span may wrap around; they are masked off below
+        uint32_t step = uint32_t(s.step_x[i]);
+        e[i] = _mm_add_epi32(_mm_set1_epi32(w[i]), _mm_setr_epi32(0, int32_t(step), int32_t(step * 2), int32_t(step * 3)));
+        step4[i] = _mm_set1_epi32(int32_t(step * 4));
+        bias[i] = _mm_set1_epi32(s.bias[i] - 1);
+    }
+    const __m128 inv_area = _mm_set1_ps(s.inv_area);
+    const __m128 z0 = _mm_set1_ps(s.z[0]);
+    const __m128 z1 = _mm_set1_ps(s.z[1]);
+    const __m128 z2 = _mm_set1_ps(s.z[2]);
+
+    uint64_t result = 0;
+    for (int x = 0; x < n; x += 4)
+    {
+        __m128i inside = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi32(e[0], bias[0]), _mm_cmpgt_epi32(e[1], bias[1])),
+                                       _mm_cmpgt_epi32(e[2], bias[2]));
+        inside = _mm_and_si128(inside, _mm_cmpgt_epi32(_mm_set1_epi32(n - x), lane));
+
+        if (_mm_movemask_ps(_mm_castsi128_ps(inside)))
+        {
+            __m128 alpha = _mm_mul_ps(_mm_cvtepi32_ps(e[0]), inv_area);
+            __m128 beta = _mm_mul_ps(_mm_cvtepi32_ps(e[1]), inv_area);
+            __m128 gamma = _mm_mul_ps(_mm_cvtepi32_ps(e[2]), inv_area);
+            __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(alpha, z0), _mm_mul_ps(beta, z1)), _mm_mul_ps(gamma, z2));
+
+            // the last block may run past the span, go through a copy so we never touch depth[n]
+            alignas(16) float tail[4] = {};
+            float* d = depth + x;
+            if (n - x < 4)
+            {
+                for (int i = 0; i < n - x; ++i)
+                    tail[i] = d[i];
+                d = tail;
+            }
+
+            __m128 old = _mm_loadu_ps(d);
+            __m128 pass = _mm_and_ps(_mm_cmplt_ps(z, old), _mm_castsi128_ps(inside));
+            _mm_storeu_ps(d, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, old)));
+
+            if (d == tail)
+                for (int i = 0; i < n - x; ++i)
+                    depth[x + i] = tail[i];
+
+            result |= uint64_t(_mm_movemask_ps(pass)) << x;
+        }
+
+        for (int i = 0; i < 3; ++i)
+            e[i] = _mm_add_epi32(e[i], step4[i]);
+    }
+    return result;
+}
+#endif
+
+rst::span_kernel rst::select_span_kernel(bool allow_simd)
+{
+    if (!allow_simd)
+        return raster_span_scalar;
+#if defined(RST_HAVE_AVX2) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2"))
+        return raster_span_avx2;
+#endif
+#if defined(__SSE2__)
+    return raster_span_sse2;
+#else
+    return raster_span_scalar;
+#endif
+}
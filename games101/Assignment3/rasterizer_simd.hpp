@@ -0,0 +1,40 @@
+//
+// Span kernels: coverage, depth interpolation and depth test for a run of pixels.
+//
+
+#pragma once
+
+#include <cstdint>
+
+namespace rst
+{
+    // Longest run a span kernel handles in one call, one result bit per pixel.
+    constexpr int SPAN_PIXELS = 64;
+
+    // Edge functions of one triangle in the 32-bit form the span kernels consume.
+    // Only triangles whose edge values fit in int32 over their whole pixel rect use this.
+    struct span_setup
+    {
+        int32_t step_x[3]; // E_i(x + 1, y) - E_i(x, y)
+        int32_t bias[3];   // a pixel is covered when E_i >= bias[i] for all i
+        float inv_area;    // E_i * inv_area is the barycentric weight of vertex i
+        float z[3];        // screen space depth of each vertex
+    };
+
+    // Tests n <= SPAN_PIXELS consecutive pixels of a row; w holds the edge values of the
+    // first one. A pixel passes when it is covered and its interpolated depth is below
+    // depth[i]; the depth of passing pixels is written back. Returns bit i set for every
+    // passing pixel i.
+    using span_kernel = uint64_t (*)(const span_setup& s, const int32_t (&w)[3], int n, float* depth);
+
+    uint64_t raster_span_scalar(const span_setup& s, const int32_t (&w)[3], int n, float* depth);
+#if defined(__SSE2__)
+    uint64_t raster_span_sse2(const span_setup& s, const int32_t (&w)[3], int n, float* depth);
+#endif
+#if defined(RST_HAVE_AVX2)
+    uint64_t raster_span_avx2(const span_setup& s, const int32_t (&w)[3], int n, float* depth);
+#endif
+
+    // Best kernel for the CPU we are running on (AVX2, then SSE2), or the scalar one.
+    span_kernel select_span_kernel(bool allow_simd = true);
+}